@@ -0,0 +1,104 @@
+#include "../../../header/rabbitmq.hpp"
+#include "../../../header/local_mq.hpp"
+#include "../../../header/logger.hpp"
+#include <gflags/gflags.h>
+
+using namespace liren;
+
+DEFINE_string(user, "root", "rabbitmq访问用户名");
+DEFINE_string(pswd, "123456", "rabbitmq访问密码");
+DEFINE_string(host, "127.0.0.1:5672", "rabbitmq服务器地址信息 host:port");
+
+DEFINE_bool(run_mode, false, "程序的运行模式，false-调试； true-发布；");
+DEFINE_string(log_file, "", "发布模式下，用于指定日志的输出文件");
+DEFINE_int32(log_level, 2, "发布模式下，用于指定日志输出等级");
+
+DEFINE_int32(count, 100000, "发布/消费的消息数量");
+DEFINE_int32(msg_size, 256, "消息大小（字节）");
+DEFINE_int32(keys, 16, "路由键数量，消息按路由键分发到处理线程");
+DEFINE_int32(work_us, 50, "每条消息模拟的处理耗时（微秒）");
+DEFINE_bool(confirm, true, "是否开启发布确认");
+DEFINE_int32(max_in_flight, 1024, "发布端在途消息上限");
+DEFINE_int32(prefetch, 256, "消费端预取数量，0表示不限制");
+DEFINE_int32(workers, 4, "消息处理线程数，0表示在事件循环线程中处理（旧行为）");
+DEFINE_int32(ack_batch, 64, "批量确认的消息数，1表示逐条确认（旧行为）");
+DEFINE_int32(shards, 1, "连接数量，消息按路由键分散到各连接");
+DEFINE_bool(unordered, false, "多连接时在每条连接上都注册消费者（不保证同一路由键的处理顺序）");
+DEFINE_bool(body_key, false, "所有消息使用同一个路由键，以消息体开头的会话编号作为顺序键分发到处理线程");
+DEFINE_bool(local, false, "使用进程内的 LocalMQ 代替 RabbitMQ，离线压测生产者与消费者");
+DEFINE_int32(publish_latency_us, 0, "LocalMQ 模拟的发布耗时（微秒）");
+DEFINE_int32(deliver_latency_us, 0, "LocalMQ 模拟的投递耗时（微秒）");
+
+// 发布与消费吞吐测试：
+//   旧行为：./bench --confirm=false --prefetch=0 --workers=0 --ack_batch=1
+//   新行为：./bench（默认参数）
+//   离线压测：./bench --local --publish_latency_us=200 --deliver_latency_us=200
+//   固定路由键：./bench --keys=1 与 ./bench --body_key 对比，前者所有消息落到同一个处理线程
+int main(int argc, char *argv[])
+{
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    init_logger(FLAGS_run_mode, FLAGS_log_file, FLAGS_log_level);
+
+    MQOptions options;
+    options.confirm = FLAGS_confirm;
+    options.max_in_flight = FLAGS_max_in_flight;
+    options.prefetch = FLAGS_prefetch;
+    options.consume_workers = FLAGS_workers;
+    options.ack_batch = FLAGS_ack_batch;
+    if (FLAGS_body_key) {
+        options.order_key = [](const std::string &, const char *body, size_t sz) {
+            const char *end = static_cast<const char *>(memchr(body, ':', sz));
+            return std::hash<std::string>()(std::string(body, end ? end - body : sz));
+        };
+    }
+    MessageQueue::ptr client;
+    if (FLAGS_local) {
+        LocalMQOptions local;
+        local.publish_latency_us = FLAGS_publish_latency_us;
+        local.deliver_latency_us = FLAGS_deliver_latency_us;
+        client = std::make_shared<LocalMQ>(options, local);
+    } else {
+        client = std::make_shared<ShardedMQClient>(FLAGS_user, FLAGS_pswd, FLAGS_host, FLAGS_shards, options);
+    }
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < (FLAGS_body_key ? 1 : FLAGS_keys); ++i) {
+        keys.push_back("bench-key-" + std::to_string(i));
+        client->declareComponents("bench-exchange", "bench-queue", keys.back());
+    }
+
+    // 1. 发布：异步提交全部消息，等待全部完成
+    std::vector<std::string> msgs;
+    for (int i = 0; i < FLAGS_keys; ++i) {
+        std::string msg = FLAGS_body_key ? std::to_string(i) + ":" : "";
+        msg.resize(std::max<size_t>(msg.size(), FLAGS_msg_size), 'x');
+        msgs.push_back(msg);
+    }
+    std::atomic<int> published(0), failed(0);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < FLAGS_count; ++i) {
+        client->publish_async("bench-exchange", msgs[i % msgs.size()], keys[i % keys.size()], [&](bool ok) {
+            ok ? ++published : ++failed;
+        });
+    }
+    while (published + failed < FLAGS_count) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    double cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "发布 " << published << " 条，失败 " << failed << " 条，" << published / cost << " 条/秒" << std::endl;
+
+    // 2. 消费：每条消息模拟固定的处理耗时
+    std::atomic<int> consumed(0);
+    start = std::chrono::steady_clock::now();
+    auto on_message = [&](const char *body, size_t sz) {
+        if (FLAGS_work_us > 0) std::this_thread::sleep_for(std::chrono::microseconds(FLAGS_work_us));
+        ++consumed;
+    };
+    auto sharded = std::dynamic_pointer_cast<ShardedMQClient>(client);
+    if (sharded && FLAGS_unordered)
+        sharded->consume_unordered("bench-queue", on_message);
+    else
+        client->consume("bench-queue", on_message);
+    while (consumed < published) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "消费 " << consumed << " 条，" << consumed / cost << " 条/秒" << std::endl;
+    return 0;
+}
@@ -0,0 +1,210 @@
+#include "../../../header/local_mq.hpp"
+#include "../../../header/logger.hpp"
+#include <gflags/gflags.h>
+#include <atomic>
+#include <map>
+#include <set>
+#include <algorithm>
+
+using namespace liren;
+
+DEFINE_bool(run_mode, false, "程序的运行模式，false-调试； true-发布；");
+DEFINE_string(log_file, "", "发布模式下，用于指定日志的输出文件");
+DEFINE_int32(log_level, 2, "发布模式下，用于指定日志输出等级");
+
+// LocalMQ 语义测试：
+//   1. topic 交换机的 * 与 # 通配
+//   2. 默认交换机（空名称）按路由键投递到同名队列，没有同名队列时丢弃
+//   3. 消费者未确认的消息数不超过 prefetch
+//   4. 回调抛出异常时消息重新投递
+//   5. consume_workers 为 0 时多次运行的处理顺序相同
+//   6. 在途名额用尽且超过 publish_timeout_ms 时发布失败
+//   7. 路由键相同时，按 order_key 把消息分散到多个处理线程，同一顺序键内保持顺序
+static int failures = 0;
+
+static void check(bool ok, const std::string &name) {
+    std::cout << (ok ? "[通过] " : "[失败] ") << name << std::endl;
+    if (!ok) ++failures;
+}
+
+// 等待条件成立，超时返回 false
+template <typename F>
+static bool wait_for(F &&cond, int timeout_ms = 2000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!cond()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+void test_topic() {
+    LocalMQ mq;
+    mq.declareComponents("topic", "star", "a.*.c", AMQP::ExchangeType::topic);
+    mq.declareComponents("topic", "hash", "a.#", AMQP::ExchangeType::topic);
+    mq.declareComponents("topic", "all", "#", AMQP::ExchangeType::topic);
+    mq.declareComponents("topic", "mid", "*.#.z", AMQP::ExchangeType::topic);
+    for (const char *key : {"a.b.c", "a.b.b.c", "a.c", "a", "a.b", "x.z", "x.y.y.z", "z"}) {
+        mq.publish("topic", key, key);
+    }
+    check(mq.depth("star") == 1, "topic: a.*.c 只匹配 a.b.c");
+    check(mq.depth("hash") == 5, "topic: a.# 匹配 a、a.b、a.c、a.b.c、a.b.b.c");
+    check(mq.depth("all") == 8, "topic: # 匹配全部路由键");
+    check(mq.depth("mid") == 2, "topic: *.#.z 匹配 x.z、x.y.y.z，不匹配 z");
+}
+
+void test_default_exchange() {
+    LocalMQ mq;
+    mq.declareComponents("direct", "orders", "order");
+    check(mq.publish("", "m1", "orders"), "默认交换机：发布成功");
+    check(mq.depth("orders") == 1, "默认交换机：投递到与路由键同名的队列");
+    check(mq.publish("", "m2", "missing"), "默认交换机：没有同名队列时发布仍成功");
+    check(mq.stats().unroutable == 1, "默认交换机：没有同名队列时消息被丢弃");
+    check(!mq.publish("no-such-exchange", "m3", "order"), "交换机不存在时发布失败");
+}
+
+void test_prefetch() {
+    MQOptions options;
+    options.prefetch = 4;
+    options.consume_workers = 1;
+    LocalMQ mq(options);
+    mq.declareComponents("direct", "q", "k");
+    for (int i = 0; i < 20; ++i) mq.publish("direct", std::to_string(i), "k");
+
+    std::mutex mtx;
+    std::condition_variable cond;
+    bool release = false;
+    std::atomic<int> consumed(0);
+    mq.consume("q", [&](const char *, size_t) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cond.wait(lock, [&]() { return release; });
+        ++consumed;
+    });
+    // 第一条消息阻塞在回调中，其余已投递的消息等待处理线程，队列中应剩余 20 - prefetch 条
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    check(mq.depth("q") == 16 && mq.stats().delivered == 4, "prefetch：未确认的消息数不超过 prefetch");
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        release = true;
+    }
+    cond.notify_all();
+    check(wait_for([&]() { return consumed == 20; }), "prefetch：确认后继续投递，全部消息被处理");
+}
+
+void test_redelivery(size_t workers) {
+    MQOptions options;
+    options.consume_workers = workers;
+    LocalMQ mq(options);
+    mq.declareComponents("direct", "q", "k");
+    std::mutex mtx;
+    std::vector<std::string> received;
+    std::atomic<int> thrown(0);
+    mq.consume("q", [&](const char *body, size_t sz) {
+        std::string msg(body, sz);
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            received.push_back(msg);
+        }
+        if (msg == "bad" && thrown++ < 2) throw std::runtime_error("处理失败");
+    });
+    mq.publish("direct", "good", "k");
+    mq.publish("direct", "bad", "k");
+    std::string name = "重新投递（处理线程数 " + std::to_string(workers) + "）：";
+    check(wait_for([&]() { return mq.stats().acked == 2; }), name + "抛出异常的消息最终被确认");
+    auto stats = mq.stats();
+    std::unique_lock<std::mutex> lock(mtx);
+    check(stats.redelivered == 2 && stats.delivered == 4, name + "每次抛出异常都重新投递一次");
+    check(received == std::vector<std::string>({"good", "bad", "bad", "bad"}), name + "重新投递的消息放回队列头部");
+}
+
+// 两个消费者、多个路由键，记录处理顺序
+std::vector<std::string> run_order() {
+    LocalMQOptions local;
+    local.publish_latency_us = 100;
+    local.deliver_latency_us = 100;
+    LocalMQ mq(MQOptions(), local);
+    mq.declareComponents("topic", "q", "k.*", AMQP::ExchangeType::topic);
+    std::vector<std::string> order; // consume_workers 为 0 时回调都在投递线程中执行
+    std::atomic<int> consumed(0);
+    for (int c = 0; c < 2; ++c) {
+        mq.consume("q", [&order, &consumed, c](const char *body, size_t sz) {
+            order.push_back(std::to_string(c) + ":" + std::string(body, sz));
+            ++consumed;
+        });
+    }
+    for (int i = 0; i < 200; ++i) mq.publish_async("topic", std::to_string(i), "k." + std::to_string(i % 5), nullptr);
+    wait_for([&]() { return consumed == 200; });
+    return order;
+}
+
+void test_determinism() {
+    auto first = run_order();
+    auto second = run_order();
+    check(first.size() == 200 && first == second, "consume_workers 为 0 时处理顺序确定");
+}
+
+void test_publish_timeout() {
+    MQOptions options;
+    options.max_in_flight = 1;
+    options.publish_timeout_ms = 100;
+    LocalMQOptions local;
+    local.publish_latency_us = 1000000; // 第一条消息一秒后才完成，一直占用唯一的名额
+    LocalMQ mq(options, local);
+    mq.declareComponents("direct", "q", "k");
+    auto first = mq.publish_async("direct", "m1", "k");
+    auto start = std::chrono::steady_clock::now();
+    bool ok = mq.publish("direct", "m2", "k");
+    auto cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    check(!ok && cost >= 100 && cost < 900, "在途名额等待超时后发布失败");
+    check(first.get(), "占用名额的消息正常完成");
+}
+
+void test_order_key() {
+    MQOptions options;
+    options.consume_workers = 4;
+    // 消息体为 "会话ID:序号"，以会话ID作为顺序键
+    options.order_key = [](const std::string &, const char *body, size_t sz) {
+        std::string msg(body, sz);
+        return std::hash<std::string>()(msg.substr(0, msg.find(':')));
+    };
+    LocalMQ mq(options);
+    mq.declareComponents("direct", "q", "routing_key");
+    std::mutex mtx;
+    std::map<std::string, std::vector<int>> received;
+    std::set<std::thread::id> threads;
+    std::atomic<int> consumed(0);
+    mq.consume("q", [&](const char *body, size_t sz) {
+        std::string msg(body, sz);
+        size_t pos = msg.find(':');
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            received[msg.substr(0, pos)].push_back(std::stoi(msg.substr(pos + 1)));
+            threads.insert(std::this_thread::get_id());
+        }
+        ++consumed;
+    });
+    for (int i = 0; i < 400; ++i) mq.publish("direct", "s" + std::to_string(i % 16) + ":" + std::to_string(i));
+    check(wait_for([&]() { return consumed == 400; }), "顺序键：全部消息被处理");
+    std::unique_lock<std::mutex> lock(mtx);
+    check(threads.size() > 1, "顺序键：路由键相同的消息分散到多个处理线程");
+    bool ordered = received.size() == 16;
+    for (auto &item : received) ordered = ordered && std::is_sorted(item.second.begin(), item.second.end());
+    check(ordered, "顺序键：同一会话的消息按发布顺序处理");
+}
+
+int main(int argc, char *argv[])
+{
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    init_logger(FLAGS_run_mode, FLAGS_log_file, FLAGS_log_level);
+
+    test_topic();
+    test_default_exchange();
+    test_prefetch();
+    test_redelivery(0);
+    test_redelivery(2);
+    test_determinism();
+    test_publish_timeout();
+    test_order_key();
+    std::cout << (failures == 0 ? "全部通过" : "存在失败的用例：" + std::to_string(failures)) << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,226 @@
+#include "../../../header/outbox.hpp"
+#include "../../../header/local_mq.hpp"
+#include "../../../header/logger.hpp"
+#include <gflags/gflags.h>
+#include <atomic>
+
+using namespace liren;
+
+DEFINE_bool(run_mode, false, "程序的运行模式，false-调试； true-发布；");
+DEFINE_string(log_file, "", "发布模式下，用于指定日志的输出文件");
+DEFINE_int32(log_level, 2, "发布模式下，用于指定日志输出等级");
+DEFINE_string(dir, "./outbox_test_data", "测试使用的日志目录，每个用例开始前清空");
+
+// MQOutbox 测试，以 LocalMQ 作为消息队列：
+//   1. 消息按提交顺序投递，全部投递后日志只保留当前段
+//   2. 交换机不存在（投递失败）时消息留在日志中，重启后恢复并按顺序补发
+//   3. 日志段末尾的不完整记录在恢复时被截掉，之前的记录正常补发
+//   4. 日志按 segment_bytes 分段，补发完成后旧段被删除
+//   5. 日志目录不可用时记录保留在内存中，目录恢复后写入日志，不丢失消息
+static int failures = 0;
+
+static void check(bool ok, const std::string &name) {
+    std::cout << (ok ? "[通过] " : "[失败] ") << name << std::endl;
+    if (!ok) ++failures;
+}
+
+// 等待条件成立，超时返回 false
+template <typename F>
+static bool wait_for(F &&cond, int timeout_ms = 3000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!cond()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+static void reset_dir() {
+    DIR *dp = opendir(FLAGS_dir.c_str());
+    if (dp) {
+        while (struct dirent *ent = readdir(dp)) {
+            std::string name = ent->d_name;
+            if (name != "." && name != "..") unlink((FLAGS_dir + "/" + name).c_str());
+        }
+        closedir(dp);
+        rmdir(FLAGS_dir.c_str());
+    }
+    mkdir(FLAGS_dir.c_str(), 0755);
+}
+
+// 日志段文件（不含位置文件）
+static std::vector<std::string> segments() {
+    std::vector<std::string> names;
+    DIR *dp = opendir(FLAGS_dir.c_str());
+    if (!dp) return names;
+    while (struct dirent *ent = readdir(dp)) {
+        std::string name = ent->d_name;
+        if (name.compare(0, 4, "log.") == 0 && name.find("offset") == std::string::npos) names.push_back(name);
+    }
+    closedir(dp);
+    return names;
+}
+
+static off_t file_size(const std::string &name) {
+    struct stat st;
+    return stat((FLAGS_dir + "/" + name).c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+static OutboxOptions make_options(const std::string &prefix) {
+    OutboxOptions options;
+    options.path = FLAGS_dir + "/log";
+    options.retry_interval_ms = 20;
+    options.shutdown_timeout_ms = 1000;
+    options.metrics_prefix = prefix;
+    return options;
+}
+
+// 订阅队列，按到达顺序收集消息
+struct Collector
+{
+    std::mutex mtx;
+    std::vector<std::string> msgs;
+    std::atomic<int> count{0};
+
+    void consume(LocalMQ &mq, const std::string &queue) {
+        mq.consume(queue, [this](const char *body, size_t sz) {
+            std::unique_lock<std::mutex> lock(mtx);
+            msgs.emplace_back(body, sz);
+            ++count;
+        });
+    }
+    bool in_order(int n) {
+        std::unique_lock<std::mutex> lock(mtx);
+        if (msgs.size() != static_cast<size_t>(n)) return false;
+        for (int i = 0; i < n; ++i)
+            if (msgs[i] != "m" + std::to_string(i)) return false;
+        return true;
+    }
+};
+
+// 向不存在的交换机提交 n 条消息：投递全部失败，消息只留在日志中
+static void spool(int n, const OutboxOptions &options) {
+    auto mq = std::make_shared<LocalMQ>();
+    MQOutbox outbox(mq, options);
+    for (int i = 0; i < n; ++i) outbox.publish("outbox-exchange", "m" + std::to_string(i), "k");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
+// 声明交换机后重启发件箱，等待日志中的消息补发完成
+static bool replay(int n, const OutboxOptions &options, Collector &collector) {
+    auto mq = std::make_shared<LocalMQ>();
+    mq->declareComponents("outbox-exchange", "outbox-queue", "k");
+    collector.consume(*mq, "outbox-queue");
+    MQOutbox outbox(mq, options);
+    bool ok = wait_for([&]() { return collector.count >= n; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100)); // 等待位置文件落盘、旧段删除
+    return ok;
+}
+
+void test_deliver() {
+    reset_dir();
+    auto mq = std::make_shared<LocalMQ>();
+    mq->declareComponents("outbox-exchange", "outbox-queue", "k");
+    Collector collector;
+    collector.consume(*mq, "outbox-queue");
+    {
+        MQOutbox outbox(mq, make_options("outbox_test_deliver"));
+        for (int i = 0; i < 500; ++i) outbox.publish("outbox-exchange", "m" + std::to_string(i), "k");
+        check(wait_for([&]() { return collector.count == 500; }), "投递：全部消息到达队列");
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    check(collector.in_order(500), "投递：按提交顺序到达");
+    check(segments().size() == 1, "投递：全部投递后只保留当前段");
+}
+
+void test_recover() {
+    reset_dir();
+    auto options = make_options("outbox_test_recover");
+    spool(200, options);
+    check(segments().size() == 1 && file_size(segments()[0]) > 0, "恢复：投递失败的消息写入日志");
+    Collector collector;
+    check(replay(200, options, collector), "恢复：重启后补发全部消息");
+    check(collector.in_order(200), "恢复：补发按提交顺序进行");
+    Collector again;
+    replay(0, options, again);
+    check(again.count == 0, "恢复：已投递的消息再次重启后不会重发");
+}
+
+void test_torn_tail() {
+    reset_dir();
+    auto options = make_options("outbox_test_torn");
+    spool(100, options);
+    auto names = segments();
+    check(names.size() == 1, "截断：日志只有一段");
+    if (names.empty()) return;
+    off_t size = file_size(names[0]);
+    // 模拟写入最后一条记录时崩溃：追加一条长度字段完整、内容不完整的记录
+    int fd = open((FLAGS_dir + "/" + names[0]).c_str(), O_WRONLY | O_APPEND);
+    uint32_t len = 1000, sum = 0;
+    std::string torn(reinterpret_cast<const char *>(&len), 4);
+    torn.append(reinterpret_cast<const char *>(&sum), 4);
+    torn.append("partial");
+    check(write(fd, torn.data(), torn.size()) == static_cast<ssize_t>(torn.size()), "截断：写入不完整记录");
+    close(fd);
+
+    Collector collector;
+    check(replay(100, options, collector), "截断：不完整记录之前的消息全部补发");
+    check(collector.in_order(100), "截断：补发按提交顺序进行");
+    check(file_size(names[0]) == size, "截断：不完整记录被截掉");
+}
+
+void test_rotate() {
+    reset_dir();
+    auto options = make_options("outbox_test_rotate");
+    options.segment_bytes = 4096;
+    options.flush_interval_ms = 1;
+    {
+        auto mq = std::make_shared<LocalMQ>();
+        MQOutbox outbox(mq, options);
+        for (int i = 0; i < 1000; ++i) {
+            outbox.publish("outbox-exchange", "m" + std::to_string(i), "k");
+            if (i % 50 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    size_t count = segments().size();
+    check(count > 3, "分段：日志超过 segment_bytes 后切换到新段（共 " + std::to_string(count) + " 段）");
+    Collector collector;
+    check(replay(1000, options, collector), "分段：重启后逐段补发全部消息");
+    check(collector.in_order(1000), "分段：跨段补发按提交顺序进行");
+    check(segments().size() == 1, "分段：补发完成后删除旧段");
+}
+
+void test_unavailable_dir() {
+    reset_dir();
+    auto options = make_options("outbox_test_unavailable");
+    rmdir(FLAGS_dir.c_str()); // 目录不存在，日志段无法创建
+    {
+        auto mq = std::make_shared<LocalMQ>();
+        MQOutbox outbox(mq, options);
+        for (int i = 0; i < 50; ++i) outbox.publish("outbox-exchange", "m" + std::to_string(i), "k");
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        mkdir(FLAGS_dir.c_str(), 0755);
+        check(wait_for([&]() { return !segments().empty() && file_size(segments()[0]) > 0; }),
+              "目录不可用：目录恢复后重新创建日志段并写入");
+    }
+    Collector collector;
+    check(replay(50, options, collector), "目录不可用：期间提交的消息没有丢失");
+    check(collector.in_order(50), "目录不可用：补发按提交顺序进行");
+}
+
+int main(int argc, char *argv[])
+{
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    init_logger(FLAGS_run_mode, FLAGS_log_file, FLAGS_log_level);
+
+    test_deliver();
+    test_recover();
+    test_torn_tail();
+    test_rotate();
+    test_unavailable_dir();
+    reset_dir();
+    rmdir(FLAGS_dir.c_str());
+    std::cout << (failures == 0 ? "全部通过" : "存在失败的用例：" + std::to_string(failures)) << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -13,6 +13,11 @@ DEFINE_string(base_service, "/service", "服务监控根目录");
 DEFINE_string(instance_name, "/file_service/instance", "当前实例名称");
 DEFINE_string(access_host, "127.0.0.1:10002", "当前实例的外部访问地址");
 
+DEFINE_int64(instance_weight, 100, "当前实例的路由权重，硬件配置越高权重越大");
+DEFINE_int32(instance_max_concurrency, 0, "当前实例的最大并发请求数，0表示不限制");
+DEFINE_string(build_version, "", "当前实例的构建版本");
+DEFINE_string(instance_zone, "", "当前实例所在机房，注册到服务中心供调用方就近路由");
+
 DEFINE_string(storage_path, "./data/", "文件存放位置");
 
 DEFINE_int32(listen_port, 10002, "Rpc服务器监听端口");
@@ -25,8 +30,16 @@ int main(int argc, char *argv[])
     liren::init_logger(FLAGS_run_mode, FLAGS_log_file, FLAGS_log_level);
 
     liren::FileServerBuilder fsb;
-    fsb.make_rpc_server(FLAGS_listen_port, FLAGS_rpc_timeout, FLAGS_rpc_threads, FLAGS_storage_path);
-    fsb.make_reg_object(FLAGS_registry_host, FLAGS_base_service + FLAGS_instance_name, FLAGS_access_host);
+    fsb.make_rpc_server(FLAGS_listen_port, FLAGS_rpc_timeout, FLAGS_rpc_threads, FLAGS_storage_path,
+        FLAGS_instance_max_concurrency);
+
+    liren::InstanceMeta meta;
+    meta.host = FLAGS_access_host;
+    meta.weight = FLAGS_instance_weight;
+    meta.max_concurrency = FLAGS_instance_max_concurrency;
+    meta.version = FLAGS_build_version;
+    meta.zone = FLAGS_instance_zone;
+    fsb.make_reg_object(FLAGS_registry_host, FLAGS_base_service + FLAGS_instance_name, meta);
     auto server = fsb.build();
     server->start();
     return 0;
@@ -213,14 +213,25 @@ namespace liren
             _reg_client->regiter(service_name, access_host);
         }
 
+        // 以结构化元数据（权重、机房、最大并发、版本）注册文件服务，并周期性上报当前负载
+        void make_reg_object(const std::string &reg_host,
+                             const std::string &service_name,
+                             const InstanceMeta &meta) 
+        {
+            _reg_client = std::make_shared<Registry>(reg_host);
+            _reg_client->regiter(service_name, meta, Registry::cpu_load());
+        }
+
         // 构造 RPC 服务器对象，并启动服务
         // 参数：
         //  - port: 监听端口
         //  - timeout: 空闲连接超时时间（秒）
         //  - num_threads: 服务器工作线程数
         //  - path: 文件存储目录，默认为 "./data/"（可以自定义目录）
+        //  - max_concurrency: 最大并发请求数，超出的请求直接被拒绝，0表示不限制
         void make_rpc_server(uint16_t port, int32_t timeout, 
-                             uint8_t num_threads, const std::string &path = "./data/") 
+                             uint8_t num_threads, const std::string &path = "./data/",
+                             int32_t max_concurrency = 0) 
         {
             _rpc_server = std::make_shared<brpc::Server>();
             // 创建 FileServiceImpl 实例，传入文件存储路径
@@ -238,6 +249,7 @@ namespace liren
             brpc::ServerOptions options;
             options.idle_timeout_sec = timeout;
             options.num_threads = num_threads;
+            options.max_concurrency = max_concurrency;
             ret = _rpc_server->Start(port, &options);
             if (ret == -1) {
                 LOG_ERROR("服务启动失败！");
@@ -1,43 +1,157 @@
 #pragma once
 #include <brpc/channel.h>
+#include <brpc/controller.h>
+#include <brpc/builtin_service.pb.h>
+#include <bthread/countdown_event.h>
+#include <butil/time.h>
+#include <bvar/bvar.h>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
 #include <string>
 #include <vector>
+#include <map>
+#include <cmath>
 #include <unordered_map>
+#include <unordered_set>
 #include <mutex>
+#include <atomic>
 #include "logger.hpp"
+#include "etcd.hpp"
 
 namespace liren {
+    // 构造信道参数：超时时间单位均为毫秒，-1表示不限制
+    //  - connection_type：single（单连接）/ pooled（连接池）/ short（短连接）
+    //  - 信道上不开启备份请求：ChannelManager为每个节点单独建立信道，brpc的备份请求只会再发往同一节点，无法绕开慢节点；
+    //    跨节点的备份请求由ServiceManager::hedged_call发起
+    inline brpc::ChannelOptions make_channel_options(int32_t connect_timeout_ms = 200,
+                                                     int32_t timeout_ms = 2000,
+                                                     int max_retry = 3,
+                                                     const std::string& connection_type = "single")
+    {
+        brpc::ChannelOptions options;
+        options.connect_timeout_ms = connect_timeout_ms;
+        options.timeout_ms = timeout_ms;
+        options.max_retry = max_retry;
+        options.connection_type = connection_type;
+        options.backup_request_ms = -1;
+        options.protocol = "baidu_std";
+        return options;
+    }
+
+    // 节点健康检查与摘除参数
+    struct HealthOptions {
+        int max_consecutive_failures = 5;   // 连续失败多少次后摘除节点
+        double latency_outlier_factor = 3.0;// 节点平均延时超过其他节点均值多少倍视为延时异常
+        int64_t latency_outlier_min_us = 50000; // 延时异常的最低门槛，避免对本身很快的服务误判
+        int64_t base_eject_ms = 1000;       // 首次摘除时长，之后每次翻倍
+        int64_t max_eject_ms = 60000;       // 摘除时长上限
+        double max_eject_percent = 0.5;     // 同一服务最多摘除的节点比例，避免全部摘除
+        int probe_interval_ms = 500;        // 探活线程的检查周期
+        int probe_timeout_ms = 200;         // 探活rpc的超时时间
+        int virtual_nodes = 160;            // 一致性哈希环上每个节点的虚拟节点数量
+        double hash_load_factor = 1.25;     // 一致性哈希的负载上限：单节点在途请求数不超过按有效权重分摊份额的该倍数，超出则顺延到下一节点
+        int64_t slow_start_ms = 30000;      // 新节点预热成功后，权重从slow_start_min_ratio线性增长到满权重的时长
+        double slow_start_min_ratio = 0.1;  // 慢启动的初始权重比例
+        double zone_min_healthy_ratio = 0.5;// 本机房可用节点占本机房节点总数的比例低于该值时，允许跨机房调用
+        double zone_max_load = 0.8;         // 本机房可用节点的平均负载高于该值时，允许跨机房调用
+    };
+
     // 单个服务的信道管理类
     class ChannelManager {
     public:
         using channel_ptr = std::shared_ptr<brpc::Channel>;
         using ptr = std::shared_ptr<ChannelManager>;
+
+        // 单个节点的信道及其健康状态
+        struct Node {
+            std::string host;
+            channel_ptr channel;
+            int consecutive_failures = 0;  // 连续失败次数
+            int consecutive_successes = 0; // 连续成功次数，用于重置摘除退避
+            double latency_us = 0;         // 调用延时的滑动平均值
+            int ejections = 0;             // 连续被摘除的次数，用于计算退避时长
+            bool ejected = false;          // 是否已被摘除
+            int64_t ejected_until_ms = 0;  // 摘除截止时间，到期后由探活线程探测
+            std::atomic<int64_t> in_flight{0}; // 已分配到该节点、尚未释放的信道句柄数，即该节点上的在途调用数
+            bool ready = false;            // 是否已完成预热（建立连接并探活成功），未就绪的节点不参与轮转
+            int64_t ready_since_ms = 0;    // 就绪时间，用于计算慢启动权重
+            int64_t weight = 100;          // 节点的基础权重，来自注册的元数据
+            double load = 0;               // 节点上报的当前负载（0~1）
+            std::string zone;              // 节点所在机房/机架
+            std::string version;           // 节点的构建版本
+            int64_t current_weight = 0;    // 平滑加权轮询中的当前权重
+        };
+        using node_ptr = std::shared_ptr<Node>;
     public:
-        ChannelManager(const std::string& service_name)
+        ChannelManager(const std::string& service_name,
+                       const brpc::ChannelOptions& options = make_channel_options(),
+                       const HealthOptions& health = HealthOptions(),
+                       const std::string& local_zone = "",
+                       const std::string& metrics_prefix = "channel")
             : _service_name(service_name)
-            , _index(0)
-        {}
+            , _local_zone(local_zone)
+            , _options(options)
+            , _health(health)
+            , _ejected_count(ejected_count, this)
+        {
+            // 以 metrics_prefix + 服务名为前缀导出摘除相关指标，可通过brpc内置的 /vars 页面查看
+            // 同一进程中有多个ServiceManager关注同一服务时，需要为它们指定不同的metrics_prefix
+            std::string prefix = metrics_prefix + _service_name;
+            _ejections.expose_as(prefix, "ejections");
+            _readmissions.expose_as(prefix, "readmissions");
+            _probe_failures.expose_as(prefix, "probe_failures");
+            _ejected_count.expose_as(prefix, "ejected");
+            _same_zone.expose_as(prefix, "same_zone_requests");
+            _cross_zone.expose_as(prefix, "cross_zone_requests");
+            _backup_requests.expose_as(prefix, "backup_requests");
+        }
 
         // 服务上线了一个节点，则调用append新增信道
+        // 新节点先处于未就绪状态，由探活线程预先建立连接并探测成功后，再以慢启动权重逐步加入轮转
         void append(const std::string& host)
         {
+            InstanceMeta meta;
+            meta.host = host;
+            append(meta);
+        }
+
+        // 以注册的元数据新增信道；节点已存在时（如快照恢复后重复通知、实例周期性更新负载）只更新元数据
+        void append(const InstanceMeta& meta)
+        {
+            const std::string& host = meta.host;
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                auto it = _hosts.find(host);
+                if(it != _hosts.end())
+                {
+                    update_meta(it->second, meta);
+                    return;
+                }
+            }
+
             // 构造初始化Channel信道
             channel_ptr channel = std::make_shared<brpc::Channel>();
-            brpc::ChannelOptions options;
-            options.connect_timeout_ms = -1;
-            options.timeout_ms = -1;
-            options.max_retry = 3;
-            options.protocol = "baidu_std";
+            brpc::ChannelOptions options = _options; // Init会修改传入的参数，这里拷贝一份
             int ret = channel->Init(host.c_str(), &options);
             if(ret != 0) {
                 LOG_ERROR("初始化 {}-{} 信道失败！", _service_name, host);
                 return;
             }
+            node_ptr node = std::make_shared<Node>();
+            node->host = host;
+            node->channel = channel;
+            update_meta(node, meta);
 
             // 先加锁再添加信息
             std::unique_lock<std::mutex> lock(_mtx);
-            _channels.push_back(channel);
-            _hosts[host] = channel;
+            if(_hosts.find(host) != _hosts.end()) return;
+            _nodes.push_back(node);
+            _hosts[host] = node;
+            // 只把新节点的虚拟节点插入哈希环，其他节点的位置保持不变
+            for(int i = 0; i < _health.virtual_nodes; ++i)
+                _ring.emplace(hash(host + "#" + std::to_string(i)), node);
         }
 
         // 服务下线了一个节点，则调用remove释放信道
@@ -51,33 +165,370 @@ namespace liren {
                 return;
             }
 
-            for(auto ait = _channels.begin(); ait != _channels.end(); ++ait)
+            for(auto ait = _nodes.begin(); ait != _nodes.end(); ++ait)
                 if(*ait == it->second)
                 {
-                    _channels.erase(ait);
+                    _nodes.erase(ait);
                     break;
                 }
+            for(int i = 0; i < _health.virtual_nodes; ++i)
+            {
+                auto rit = _ring.find(hash(host + "#" + std::to_string(i)));
+                if(rit != _ring.end() && rit->second == it->second) _ring.erase(rit);
+            }
             _hosts.erase(it);
         }
 
-        // 通过RR轮转策略，获取一个Channel用于发起对应服务的rpc调用
-        channel_ptr get()
+        // 通过平滑加权轮询策略，获取一个Channel用于发起对应服务的rpc调用（跳过已摘除、未就绪的节点）
+        // exclude不为空时跳过该信道所在的节点（用于备份请求选择另一个节点），没有其他节点时返回空
+        channel_ptr get(const channel_ptr& exclude = channel_ptr())
         {
             std::unique_lock<std::mutex> lock(_mtx);
-            if(_channels.size() == 0)
+            if(_nodes.size() == 0)
             {
                 LOG_ERROR("当前无信道可用，已为你创建新信道");
                 return channel_ptr();
             }
-            int32_t idx = _index++ % _channels.size();
-            return _channels[idx];
+
+            // 优先选择已就绪且未摘除的节点（本机房容量足够时只选本机房节点）；
+            // 没有时退化到未摘除的节点（如启动时所有节点都在预热），再退化到全部节点
+            bool local_only = prefer_local_zone();
+            std::vector<node_ptr> candidates;
+            for(auto& node : _nodes)
+                if(node->channel != exclude && usable(node) && (!local_only || node->zone == _local_zone))
+                    candidates.push_back(node);
+            if(candidates.empty())
+                for(auto& node : _nodes)
+                    if(node->channel != exclude && node->ejected == false) candidates.push_back(node);
+            if(candidates.empty())
+                for(auto& node : _nodes)
+                    if(node->channel != exclude) candidates.push_back(node);
+            if(candidates.empty()) return channel_ptr();
+            if(exclude) _backup_requests << 1;
+
+            int64_t now = now_ms();
+            int64_t total = 0;
+            node_ptr best;
+            for(auto& node : candidates)
+            {
+                int64_t weight = effective_weight(node, now);
+                node->current_weight += weight;
+                total += weight;
+                if(!best || node->current_weight > best->current_weight) best = node;
+            }
+            best->current_weight -= total;
+            count_zone(best);
+            return lease(best);
+        }
+
+        // 通过一致性哈希获取Channel：相同的affinity_key总是落到同一节点上，以利用节点上的缓存
+        // 节点的在途调用数达到其容量时，顺着哈希环分配到下一个节点；容量为全部在途调用数（含本次）
+        // 按有效权重（基础权重、负载、慢启动）分摊到该节点的份额乘以hash_load_factor，预热中的节点因此只承担较少的key
+        // 在途调用数在获取信道时增加，返回的信道句柄全部释放时减少，与是否调用feedback无关
+        channel_ptr get(const std::string& affinity_key)
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            if(_ring.empty())
+            {
+                LOG_ERROR("当前无信道可用，已为你创建新信道");
+                return channel_ptr();
+            }
+
+            int64_t now = now_ms();
+            bool local_only = prefer_local_zone();
+            int64_t in_flight = 1, total_weight = 0;
+            for(auto& node : _nodes)
+            {
+                in_flight += node->in_flight;
+                if(usable(node) && (!local_only || node->zone == _local_zone))
+                    total_weight += effective_weight(node, now);
+            }
+
+            uint64_t key_hash = hash(affinity_key);
+            auto start = _ring.lower_bound(key_hash);
+            if(start == _ring.end()) start = _ring.begin();
+
+            node_ptr target, fallback; // fallback为哈希环上第一个未摘除的节点，所有可用节点都超出负载上限时使用
+            auto it = start;
+            for(size_t i = 0; i < _ring.size(); ++i)
+            {
+                const node_ptr& node = it->second;
+                if(node->ejected == false && !fallback) fallback = node;
+                if(usable(node) && (!local_only || node->zone == _local_zone))
+                {
+                    int64_t capacity = (int64_t)std::ceil(
+                        in_flight * _health.hash_load_factor * effective_weight(node, now) / total_weight);
+                    if(node->in_flight < capacity)
+                    {
+                        target = node;
+                        break;
+                    }
+                }
+                if(++it == _ring.end()) it = _ring.begin();
+            }
+            if(!target) target = fallback ? fallback : start->second; // 全部被摘除时仍按哈希结果返回
+            count_zone(target);
+            return lease(target);
+        }
+
+        // 设置本实例所在机房，之后优先选择同机房的节点
+        void set_local_zone(const std::string& zone)
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _local_zone = zone;
+        }
+
+        // 上报一次rpc调用的结果：统计连续失败次数与延时，必要时摘除节点
+        void feedback(const channel_ptr& channel, bool failed, int64_t latency_us)
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            node_ptr node = find(channel);
+            if(!node) return;
+            if(node->ejected) return;
+
+            if(failed)
+            {
+                node->consecutive_successes = 0;
+                if(++node->consecutive_failures >= _health.max_consecutive_failures)
+                    eject(node, "连续调用失败");
+                return;
+            }
+
+            node->consecutive_failures = 0;
+            if(++node->consecutive_successes >= 100) node->ejections = 0;
+            // 滑动平均延时，新样本权重为1/8
+            node->latency_us = node->latency_us == 0 ? latency_us : node->latency_us * 0.875 + latency_us * 0.125;
+            if(is_latency_outlier(node))
+                eject(node, "延时异常");
+        }
+
+        // 由探活线程调用：对摘除到期的节点以及未就绪的新节点发送轻量的健康检查rpc
+        //  - 摘除节点探测成功则恢复到轮转中，失败则继续摘除
+        //  - 新节点探测成功即完成预热（连接已建立），开始慢启动
+        void probe()
+        {
+            int64_t now = now_ms();
+            std::vector<node_ptr> due;
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                for(auto& node : _nodes)
+                    if((node->ejected && node->ejected_until_ms <= now) || node->ready == false)
+                        due.push_back(node);
+            }
+
+            for(auto& node : due)
+            {
+                std::string errmsg;
+                bool ok = health_check(node, errmsg);
+
+                std::unique_lock<std::mutex> lock(_mtx);
+                if(_hosts.find(node->host) == _hosts.end()) continue; // 探活期间节点已经下线
+                if(node->ready == false)
+                {
+                    if(!ok)
+                    {
+                        LOG_WARN("{}-{} 新节点预热探测失败：{}", _service_name, node->host, errmsg);
+                        continue;
+                    }
+                    node->ready = true;
+                    node->ready_since_ms = now_ms();
+                    LOG_INFO("{}-{} 新节点预热完成，开始慢启动", _service_name, node->host);
+                    continue;
+                }
+                if(!ok)
+                {
+                    _probe_failures << 1;
+                    eject(node, "探活失败：" + errmsg, true);
+                    continue;
+                }
+                node->ejected = false;
+                node->consecutive_failures = 0;
+                node->consecutive_successes = 0;
+                node->latency_us = 0;
+                node->ready_since_ms = now_ms(); // 恢复的节点同样经过慢启动
+                _readmissions << 1;
+                LOG_INFO("{}-{} 节点探活成功，恢复到轮转中", _service_name, node->host);
+            }
+        }
+
+    private:
+        // 使用brpc内置的health服务进行探活，不依赖业务接口；对新节点而言这次调用同时完成了连接的建立
+        bool health_check(const node_ptr& node, std::string& errmsg)
+        {
+            brpc::health_Stub stub(node->channel.get());
+            brpc::HealthRequest req;
+            brpc::HealthResponse rsp;
+            brpc::Controller cntl;
+            cntl.set_timeout_ms(_health.probe_timeout_ms);
+            cntl.set_max_retry(0);
+            stub.default_method(&cntl, &req, &rsp, nullptr);
+            if(cntl.Failed()) errmsg = cntl.ErrorText();
+            return !cntl.Failed();
+        }
+
+        static int64_t now_ms()
+        {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        // 64位FNV-1a哈希，再经过一次混淆使虚拟节点在环上分布更均匀
+        static uint64_t hash(const std::string& key)
+        {
+            uint64_t h = 14695981039346656037ULL;
+            for(unsigned char c : key)
+            {
+                h ^= c;
+                h *= 1099511628211ULL;
+            }
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            return h;
+        }
+
+        static int ejected_count(void* arg)
+        {
+            ChannelManager* self = static_cast<ChannelManager*>(arg);
+            std::unique_lock<std::mutex> lock(self->_mtx);
+            int count = 0;
+            for(auto& node : self->_nodes)
+                if(node->ejected) ++count;
+            return count;
+        }
+
+        // 以下接口均需在持有_mtx的情况下调用
+        static void update_meta(const node_ptr& node, const InstanceMeta& meta)
+        {
+            node->weight = std::max<int64_t>(1, meta.weight);
+            node->load = meta.load;
+            node->zone = meta.zone;
+            node->version = meta.version;
+        }
+
+        static bool usable(const node_ptr& node)
+        {
+            return node->ready && node->ejected == false;
+        }
+
+        // 判断是否只在本机房内选择节点：本机房可用节点比例不低于zone_min_healthy_ratio，
+        // 且平均负载不高于zone_max_load时只选本机房，否则溢出到其他机房
+        bool prefer_local_zone()
+        {
+            if(_local_zone.empty()) return false;
+            size_t total = 0, healthy = 0;
+            double load = 0;
+            for(auto& node : _nodes)
+            {
+                if(node->zone != _local_zone) continue;
+                ++total;
+                if(!usable(node)) continue;
+                ++healthy;
+                load += node->load;
+            }
+            if(healthy == 0) return false;
+            if(healthy < total * _health.zone_min_healthy_ratio) return false;
+            return load / healthy <= _health.zone_max_load;
+        }
+
+        // 统计同机房/跨机房的调用次数，用于验证就近路由的效果
+        void count_zone(const node_ptr& node)
+        {
+            if(_local_zone.empty()) return;
+            if(node->zone == _local_zone) _same_zone << 1;
+            else _cross_zone << 1;
+        }
+
+        // 节点的有效权重：基础权重 × 剩余容量比例 × 慢启动系数
+        //  - 剩余容量比例为1减去节点上报的负载，最低保留0.1，避免高负载节点完全拿不到流量而无法更新负载
+        //  - 慢启动系数在slow_start_ms内从slow_start_min_ratio线性增长到1
+        int64_t effective_weight(const node_ptr& node, int64_t now)
+        {
+            double ratio = 1.0;
+            if(node->ready && _health.slow_start_ms > 0 && now - node->ready_since_ms < _health.slow_start_ms)
+            {
+                double progress = (double)(now - node->ready_since_ms) / _health.slow_start_ms;
+                ratio = _health.slow_start_min_ratio + (1.0 - _health.slow_start_min_ratio) * progress;
+            }
+            ratio *= std::max(0.1, 1.0 - node->load);
+            return std::max<int64_t>(1, (int64_t)(node->weight * ratio));
+        }
+
+        // 把节点的信道包装成一个在途句柄返回：句柄与节点共享同一个brpc::Channel，
+        // 最后一份拷贝析构时归还该节点的在途名额，调用方持有信道期间即视为调用在途
+        channel_ptr lease(const node_ptr& node)
+        {
+            ++node->in_flight;
+            std::weak_ptr<Node> weak = node;
+            channel_ptr channel = node->channel;
+            return channel_ptr(channel.get(), [weak, channel](brpc::Channel*) {
+                if(auto node = weak.lock()) --node->in_flight;
+            });
+        }
+
+        node_ptr find(const channel_ptr& channel)
+        {
+            for(auto& node : _nodes)
+                if(node->channel == channel) return node;
+            return node_ptr();
+        }
+
+        // 与其他未摘除节点的平均延时比较，判断该节点是否为延时异常节点
+        bool is_latency_outlier(const node_ptr& node)
+        {
+            if(node->latency_us < _health.latency_outlier_min_us) return false;
+            double total = 0;
+            int count = 0;
+            for(auto& other : _nodes)
+            {
+                if(other == node || other->ejected || other->latency_us == 0) continue;
+                total += other->latency_us;
+                ++count;
+            }
+            if(count == 0) return false;
+            return node->latency_us > total / count * _health.latency_outlier_factor;
+        }
+
+        // 摘除节点，摘除时长按照连续摘除次数指数退避；force为true表示探活失败，不受摘除比例限制
+        void eject(const node_ptr& node, const std::string& reason, bool force = false)
+        {
+            if(!force)
+            {
+                size_t ejected = 0;
+                for(auto& other : _nodes)
+                    if(other->ejected) ++ejected;
+                if(ejected + 1 > _nodes.size() * _health.max_eject_percent)
+                {
+                    LOG_WARN("{}-{} 节点{}，但已达到摘除比例上限，暂不摘除", _service_name, node->host, reason);
+                    return;
+                }
+            }
+            int64_t duration = _health.base_eject_ms << std::min(node->ejections, 16);
+            duration = std::min(duration, _health.max_eject_ms);
+            node->ejected = true;
+            node->ejected_until_ms = now_ms() + duration;
+            node->consecutive_failures = 0;
+            ++node->ejections;
+            _ejections << 1;
+            LOG_WARN("{}-{} 节点{}，摘除 {} 毫秒", _service_name, node->host, reason, duration);
         }
     private:
         std::mutex _mtx;
-        int32_t _index;                                      // 当前轮转下标计数器
         std::string _service_name;                           // 服务名
-        std::vector<channel_ptr> _channels;                  // 存放channel的集合
-        std::unordered_map<std::string, channel_ptr> _hosts; // 存放主机号与channel的映射关系
+        std::string _local_zone;                             // 本实例所在机房，为空表示不区分机房
+        brpc::ChannelOptions _options;                       // 该服务所有信道共用的参数
+        HealthOptions _health;                               // 健康检查与摘除参数
+        std::vector<node_ptr> _nodes;                        // 存放节点信息的集合
+        std::unordered_map<std::string, node_ptr> _hosts;    // 存放主机号与节点的映射关系
+        std::map<uint64_t, node_ptr> _ring;                  // 一致性哈希环：虚拟节点哈希值到节点的映射
+
+        bvar::Adder<int64_t> _ejections;                     // 摘除次数
+        bvar::Adder<int64_t> _readmissions;                  // 探活成功恢复的次数
+        bvar::Adder<int64_t> _probe_failures;                // 探活失败次数
+        bvar::PassiveStatus<int> _ejected_count;             // 当前处于摘除状态的节点数量
+        bvar::Adder<int64_t> _same_zone;                     // 同机房调用次数
+        bvar::Adder<int64_t> _cross_zone;                    // 跨机房调用次数
+        bvar::Adder<int64_t> _backup_requests;               // 为备份请求选择节点的次数
     };
 
     // 总体服务的信道管理类
@@ -85,7 +536,83 @@ namespace liren {
     public:
         using channel_ptr = std::shared_ptr<brpc::Channel>;
         using ptr = std::shared_ptr<ServiceManager>;
+    private:
+        // 一次带备份请求的调用：下标0为首次调用，下标1为备份请求
+        template <typename Response>
+        struct Hedge {
+            ChannelManager::ptr service;
+            bthread::CountdownEvent event{1}; // 有一路调用成功，或已发出的调用全部失败时唤醒调用方
+            std::mutex mtx;
+            channel_ptr channel[2];
+            brpc::Controller cntl[2];
+            Response rsp[2];
+            bool done[2] = {false, false};
+            int issued = 0;   // 已发出的调用数
+            int finished = 0; // 已完成的调用数
+            int winner = -1;  // 第一路成功的调用
+            int last = 0;     // 最后完成的调用，全部失败时返回它的错误信息
+        };
+
+        // 单路调用的完成回调：上报调用结果（被取消的调用除外）并释放信道
+        template <typename Response>
+        struct HedgeDone : public google::protobuf::Closure {
+            HedgeDone(const std::shared_ptr<Hedge<Response>>& s, int i) : state(s), index(i) {}
+            void Run() override
+            {
+                std::unique_ptr<HedgeDone> guard(this);
+                brpc::Controller& cntl = state->cntl[index];
+                if(cntl.ErrorCode() != ECANCELED)
+                    state->service->feedback(state->channel[index], cntl.Failed(), cntl.latency_us());
+                state->channel[index].reset();
+                bool wake = false;
+                {
+                    std::unique_lock<std::mutex> lock(state->mtx);
+                    state->done[index] = true;
+                    state->last = index;
+                    ++state->finished;
+                    if(state->winner < 0 && !cntl.Failed())
+                    {
+                        state->winner = index;
+                        wake = true;
+                    }
+                    else if(state->winner < 0 && state->finished == state->issued) wake = true;
+                }
+                if(wake) state->event.signal();
+            }
+            std::shared_ptr<Hedge<Response>> state;
+            int index;
+        };
     public:
+        // metrics_prefix为该对象下所有服务指标名的前缀，同一进程中的多个ServiceManager应各不相同
+        ServiceManager(const HealthOptions& health = HealthOptions(), const std::string& metrics_prefix = "channel")
+            : _health(health)
+            , _metrics_prefix(metrics_prefix)
+            , _running(true)
+        {
+            // 启动探活线程，周期性地对摘除到期的节点进行探测
+            _probe_thread = std::thread([this]() {
+                std::unique_lock<std::mutex> lock(_probe_mtx);
+                while(_running)
+                {
+                    _probe_cond.wait_for(lock, std::chrono::milliseconds(_health.probe_interval_ms));
+                    if(!_running) break;
+                    lock.unlock();
+                    for(auto& service : services()) service->probe();
+                    lock.lock();
+                }
+            });
+        }
+
+        ~ServiceManager()
+        {
+            {
+                std::unique_lock<std::mutex> lock(_probe_mtx);
+                _running = false;
+            }
+            _probe_cond.notify_all();
+            _probe_thread.join();
+        }
+
         // 获取对应服务的一个channel对象，用于rpc调用
         ChannelManager::channel_ptr getChannel(const std::string& service_name)
         {
@@ -99,6 +626,113 @@ namespace liren {
             return it->second->get();
         }
 
+        // 按照affinity_key获取channel对象：相同的key（如文件ID、用户ID）尽量落到同一节点上
+        ChannelManager::channel_ptr getChannel(const std::string& service_name, const std::string& affinity_key)
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            auto it = _services.find(service_name);
+            if(it == _services.end())
+            {
+                LOG_ERROR("没有提供 {} 服务的节点", service_name);
+                return ChannelManager::channel_ptr();
+            }
+            return it->second->get(affinity_key);
+        }
+
+        // rpc调用结束后上报调用结果，用于节点的失败统计与延时异常检测
+        void feedback(const std::string& service_name, const channel_ptr& channel, const brpc::Controller& cntl)
+        {
+            ChannelManager::ptr service;
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                auto it = _services.find(service_name);
+                if(it == _services.end()) return;
+                service = it->second;
+            }
+            service->feedback(channel, cntl.Failed(), cntl.latency_us());
+        }
+
+        // 跨节点的备份请求，只能用于幂等调用（如下载文件），非幂等调用（如上传文件）应通过getChannel发起且不开启重试：
+        //  - 先向选出的节点发起调用（affinity_key为空时轮询，否则按一致性哈希选择）
+        //  - backup_request_ms内没有返回时，从其他节点中再选出一个发起同样的调用，backup_request_ms小于0时不发起
+        //  - 采用先成功返回的结果并取消另一路调用；每一路调用的结果都会上报feedback（被取消的调用除外）
+        // call(channel, cntl, rsp, done) 负责以异步方式发起一次rpc调用
+        // 成功时把响应交换到rsp中并返回true，失败时errmsg为最后完成的那一路调用的错误信息
+        template <typename Response, typename Call>
+        bool hedged_call(const std::string& service_name, const std::string& affinity_key,
+                         int32_t backup_request_ms, const Call& call, Response* rsp, std::string* errmsg)
+        {
+            ChannelManager::ptr service;
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                auto it = _services.find(service_name);
+                if(it == _services.end())
+                {
+                    LOG_ERROR("没有提供 {} 服务的节点", service_name);
+                    *errmsg = "没有提供服务的节点";
+                    return false;
+                }
+                service = it->second;
+            }
+            channel_ptr primary = affinity_key.empty() ? service->get() : service->get(affinity_key);
+            if(!primary)
+            {
+                *errmsg = "没有可用的服务节点";
+                return false;
+            }
+
+            auto state = std::make_shared<Hedge<Response>>();
+            state->service = service;
+            state->issued = 1;
+            state->channel[0] = primary;
+            call(primary.get(), &state->cntl[0], &state->rsp[0], new HedgeDone<Response>(state, 0));
+            if(backup_request_ms >= 0 &&
+               state->event.timed_wait(butil::milliseconds_from_now(backup_request_ms)) != 0)
+            {
+                channel_ptr backup = service->get(primary);
+                bool launch = false;
+                if(backup)
+                {
+                    std::unique_lock<std::mutex> lock(state->mtx);
+                    // 首次调用可能恰好在此之前完成，此时不再发起备份请求
+                    if(state->finished == 0)
+                    {
+                        state->issued = 2;
+                        state->channel[1] = backup;
+                        launch = true;
+                    }
+                }
+                if(launch) call(backup.get(), &state->cntl[1], &state->rsp[1], new HedgeDone<Response>(state, 1));
+            }
+            state->event.wait();
+
+            std::vector<brpc::CallId> pending;
+            int winner;
+            {
+                std::unique_lock<std::mutex> lock(state->mtx);
+                winner = state->winner;
+                if(winner < 0)
+                {
+                    *errmsg = state->cntl[state->last].ErrorText();
+                    return false;
+                }
+                for(int i = 0; i < state->issued; ++i)
+                    if(i != winner && !state->done[i]) pending.push_back(state->cntl[i].call_id());
+            }
+            // 取消仍在进行的另一路调用，它的完成回调持有state，不会访问已释放的内存
+            for(auto& id : pending) brpc::StartCancel(id);
+            rsp->Swap(&state->rsp[winner]);
+            return true;
+        }
+
+        // 设置本实例所在机房，所有服务的信道选择都会优先同机房的节点
+        void set_local_zone(const std::string& zone)
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _local_zone = zone;
+            for(auto& it : _services) it.second->set_local_zone(zone);
+        }
+
         // 声明关注哪些服务的上下线调用，不关注的服务不需要处理
         void declared(const std::string& service_name)
         {
@@ -106,9 +740,20 @@ namespace liren {
             _follow_services.insert(service_name);
         }
 
+        // 声明关注的服务，并为该服务的信道指定参数（超时、重试、连接方式等）
+        void declared(const std::string& service_name, const brpc::ChannelOptions& options)
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _follow_services.insert(service_name);
+            _options[service_name] = options;
+        }
+
         // 服务上线时调用的回调接口（即etcd.hpp中Discovery类的put_cb对象）：为服务添加主机地址
-        void online(const std::string& instance_name, const std::string& host)
+        // value为实例注册的元数据（兼容只有访问地址的旧格式），同一实例更新元数据时也会回调该接口
+        void online(const std::string& instance_name, const std::string& value)
         {
+            InstanceMeta meta = InstanceMeta::parse(value);
+            const std::string& host = meta.host;
             std::string service_name = instance_to_service(instance_name);
             ChannelManager::ptr service;
             {
@@ -123,8 +768,14 @@ namespace liren {
                 auto it = _services.find(service_name);
                 if(it == _services.end())
                 {
-                    // 说明是新添加的服务节点，此时创建并且插入即可
-                    service = std::make_shared<ChannelManager>(service_name);
+                    // 说明是新添加的服务节点，此时创建并且插入即可（未单独配置参数的服务使用默认参数）
+                    auto oit = _options.find(service_name);
+                    if(oit == _options.end())
+                        service = std::make_shared<ChannelManager>(service_name, make_channel_options(), _health,
+                                                                   _local_zone, _metrics_prefix);
+                    else
+                        service = std::make_shared<ChannelManager>(service_name, oit->second, _health,
+                                                                   _local_zone, _metrics_prefix);
                     _services[service_name] = service;
                 }
                 else
@@ -135,13 +786,15 @@ namespace liren {
                 LOG_ERROR("新增 {} 服务管理节点失败！", service_name);
                 return ;
             }
-            service->append(host);
+            service->append(meta);
+            _probe_cond.notify_all(); // 立即唤醒探活线程对新节点进行预热
             LOG_DEBUG("{}-{} 服务上线新节点，进行添加管理！", service_name, host);
         }
 
         // 服务下线时调用的回调接口（即etcd.hpp中Discovery类的del_cb对象）：删除服务节点
-        void offline(const std::string& instance_name, const std::string& host)
+        void offline(const std::string& instance_name, const std::string& value)
         {
+            std::string host = InstanceMeta::parse(value).host;
             std::string service_name = instance_to_service(instance_name);
             ChannelManager::ptr service;
             {
@@ -165,6 +818,15 @@ namespace liren {
             LOG_DEBUG("{}-{} 服务下线节点，进行删除管理！", service_name, host);
         }
     private:
+        // 获取当前所有服务的信道管理对象，供探活线程在不持有锁的情况下遍历
+        std::vector<ChannelManager::ptr> services()
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            std::vector<ChannelManager::ptr> res;
+            for(auto& it : _services) res.push_back(it.second);
+            return res;
+        }
+
         // 将实例名转化为服务名（实际上就是去掉最后一个'/'后面的内容
         std::string instance_to_service(const std::string& instance)
         {
@@ -175,6 +837,15 @@ namespace liren {
     private:
         std::mutex _mtx;
         std::unordered_set<std::string> _follow_services;               // 存放关注的服务集合
+        std::unordered_map<std::string, brpc::ChannelOptions> _options; // 存放服务名和信道参数映射的集合
         std::unordered_map<std::string, ChannelManager::ptr> _services; // 存放服务名和ChannelManager映射的集合
+
+        HealthOptions _health;                // 健康检查与摘除参数
+        std::string _metrics_prefix;          // 指标名前缀
+        std::string _local_zone;              // 本实例所在机房
+        bool _running;                        // 探活线程是否继续运行
+        std::mutex _probe_mtx;
+        std::condition_variable _probe_cond;
+        std::thread _probe_thread;            // 探活线程
     };
 }
\ No newline at end of file
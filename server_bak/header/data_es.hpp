@@ -69,6 +69,21 @@ namespace liren
             return true;
         }
 
+        // updateField 方法用于更新用户文档中的单个字段（昵称、签名、手机号、头像ID）
+        // 只提交该字段，不需要先获取完整的用户信息；文档不存在时 missing 置为 true，由调用方改为写入完整文档
+        bool updateField(const std::string &uid, const std::string &field, const std::string &val,
+                         bool *missing = nullptr) 
+        {
+            bool ret = ESUpdate(_es_client, "user")
+                .append(field, val)
+                .update(uid, missing);
+            if (ret == false) {
+                LOG_ERROR("用户数据 {} 字段 {} 更新失败!", uid, field);
+                return false;
+            }
+            return true;
+        }
+
         // search 方法用于基于关键字搜索用户数据
         // 参数 key 为搜索关键字，uid_list 为排除的用户ID列表（must_not 条件）
         // 返回值为符合条件的 User 对象的 vector
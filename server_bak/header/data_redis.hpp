@@ -1,8 +1,391 @@
+#pragma once
 #include <sw/redis++/redis.h>   // 引入 Redis++ 库，用于与 Redis 数据库交互
+#include <bvar/bvar.h>           // 命令耗时与并发度统计
+#include "token.hpp"             // 签名会话令牌
+#include "logger.hpp"
 #include <iostream>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <unordered_map>
+#include <iterator>
+#include <atomic>
+#include <condition_variable>
+#include <shared_mutex>
+#include <unordered_set>
+#include <algorithm>
+#include <functional>
+#include <random>
 
 namespace liren 
 {
+    // RedisScript 类封装 Lua 脚本的执行
+    // 首次执行时通过 SCRIPT LOAD 缓存脚本并记录 SHA1，之后通过 EVALSHA 执行，只传输脚本摘要
+    // Redis 重启导致脚本缓存丢失（NOSCRIPT）时自动重新加载
+    class RedisScript 
+    {
+    public:
+        RedisScript(const std::string &script)
+            : _script(script)
+        {}
+
+        template <typename Ret>
+        Ret run(sw::redis::Redis &redis,
+                const std::vector<std::string> &keys,
+                const std::vector<std::string> &args) 
+        {
+            std::string sha = load(redis, false);
+            try {
+                return redis.evalsha<Ret>(sha, keys.begin(), keys.end(), args.begin(), args.end());
+            } catch (const sw::redis::ReplyError &e) {
+                if (std::string(e.what()).find("NOSCRIPT") == std::string::npos) throw;
+            }
+            sha = load(redis, true);
+            return redis.evalsha<Ret>(sha, keys.begin(), keys.end(), args.begin(), args.end());
+        }
+
+        // 集群模式下各节点的脚本缓存相互独立，直接使用 EVAL 由客户端按第一个键路由到对应节点
+        template <typename Ret>
+        Ret run(sw::redis::RedisCluster &redis,
+                const std::vector<std::string> &keys,
+                const std::vector<std::string> &args) 
+        {
+            return redis.eval<Ret>(_script, keys.begin(), keys.end(), args.begin(), args.end());
+        }
+    private:
+        std::string load(sw::redis::Redis &redis, bool reload) 
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            if (_sha.empty() || reload) _sha = redis.script_load(_script);
+            return _sha;
+        }
+    private:
+        std::mutex _mtx;
+        std::string _script; // Lua 脚本内容
+        std::string _sha;    // 脚本加载后的 SHA1 摘要
+    };
+
+    // RedisKey 定义各类数据的键名规则
+    // 同一用户的会话与在线状态键都带有 {uid} 哈希标签，集群模式下落在同一槽位，可以放在同一脚本/流水线中执行
+    struct RedisKey 
+    {
+        // 会话ID：以 {uid} 作为前缀，使会话键能够携带用户的哈希标签
+        static std::string make_ssid(const std::string &uid, const std::string &id) {
+            return "{" + uid + "}" + id;
+        }
+        static std::string session(const std::string &ssid) { return "session:" + ssid; }
+        static std::string status(const std::string &uid) { return "status:{" + uid + "}"; }
+        static std::string code(const std::string &cid) { return "code:" + cid; }
+        static std::string user(const std::string &uid) { return "user:{" + uid + "}"; }
+        static std::string user_version(const std::string &uid) { return "user_ver:{" + uid + "}"; }
+
+        // 取出键中的哈希标签（第一对花括号中的非空内容），没有则返回整个字符串，与 Redis Cluster 的槽位计算规则一致
+        static std::string hash_tag(const std::string &key) {
+            size_t begin = key.find('{');
+            if (begin == std::string::npos) return key;
+            size_t end = key.find('}', begin + 1);
+            if (end == std::string::npos || end == begin + 1) return key;
+            return key.substr(begin + 1, end - begin - 1);
+        }
+
+        // 键所在的槽位：对哈希标签做 CRC16（XMODEM）后对 16384 取模，与 Redis Cluster 一致
+        static uint16_t slot(const std::string &key) {
+            uint16_t crc = 0;
+            for (unsigned char c : hash_tag(key)) {
+                crc ^= static_cast<uint16_t>(c) << 8;
+                for (int i = 0; i < 8; ++i) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+            }
+            return crc & 16383;
+        }
+    };
+
+    // Redis 客户端的连接池与超时参数，默认值与 redis++ 保持一致
+    struct RedisOptions 
+    {
+        size_t pool_size = 1;                              // 连接池大小，brpc 工作线程较多时需要相应调大
+        std::chrono::milliseconds pool_wait_timeout{0};    // 连接池耗尽时等待空闲连接的超时时间，0 表示一直等待
+        std::chrono::milliseconds connection_lifetime{0};  // 连接最长存活时间，超过后重建连接，0 表示不限制
+        std::chrono::milliseconds connect_timeout{0};      // 建立连接超时时间，0 表示不限制
+        std::chrono::milliseconds socket_timeout{0};       // 单条命令读写超时时间，0 表示不限制
+        std::string metrics_prefix = "redis";              // bvar 指标名称前缀
+    };
+
+    // 集群槽位分布的缓存时长，槽位迁移导致流水线出错时会提前失效
+    constexpr std::chrono::seconds kSlotsTTL{30};
+
+    // RedisClient 类统一封装单机 Redis 与 Redis Cluster 两种部署方式
+    // 通过 call 传入泛型 lambda，由其根据实际部署方式调用 sw::redis::Redis 或 sw::redis::RedisCluster 的同名接口
+    // 每次调用按命令名称记录耗时分布，并记录调用发起时正在执行的命令数量：
+    // 该并发度持续高于连接池大小说明调用方在排队等待空闲连接（redis++ 未直接暴露连接池等待时间）
+    class RedisClient 
+    {
+    public:
+        using ptr = std::shared_ptr<RedisClient>;
+
+        explicit RedisClient(const std::shared_ptr<sw::redis::Redis> &redis,
+                             const std::string &metrics_prefix = "redis")
+            : _redis(redis)
+            , _prefix(metrics_prefix)
+            , _in_flight_status(get_in_flight, this)
+        {
+            expose();
+        }
+        explicit RedisClient(const std::shared_ptr<sw::redis::RedisCluster> &cluster,
+                             const std::string &metrics_prefix = "redis")
+            : _cluster(cluster)
+            , _prefix(metrics_prefix)
+            , _in_flight_status(get_in_flight, this)
+        {
+            expose();
+        }
+
+        // 是否为集群模式：集群模式下一条 Lua 脚本或流水线中的所有键必须位于同一个槽位
+        bool cluster() const { return _cluster != nullptr; }
+
+        // 执行一次 Redis 操作，cmd 为统计耗时使用的命令名称
+        template <typename F>
+        auto call(const std::string &cmd, F &&f) -> decltype(f(std::declval<sw::redis::Redis &>())) 
+        {
+            Timer timer(this, cmd);
+            if (_cluster) return f(*_cluster);
+            return f(*_redis);
+        }
+
+        // 创建流水线：集群模式下流水线绑定到 hash_tag 所在的节点，其中的键必须带有相同的哈希标签
+        // （或者由 group_by_node 分到同一组）
+        sw::redis::Pipeline pipeline(const std::string &hash_tag) {
+            if (_cluster) return _cluster->pipeline(hash_tag, false);
+            return _redis->pipeline(false);
+        }
+
+        // 把键按所在节点分组，返回每组键在 keys 中的下标；同组的键位于同一节点，可以放进以组内第一个键的哈希标签
+        // 创建的同一条流水线中（流水线中的命令各自执行，不要求同一槽位），一次往返完成
+        // 槽位分布来自 CLUSTER SLOTS 并缓存 kSlotsTTL，获取失败时退化为按槽位分组；单机模式下全部键为一组
+        std::vector<std::vector<size_t>> group_by_node(const std::vector<std::string> &keys) {
+            std::vector<std::vector<size_t>> groups;
+            if (!_cluster) {
+                groups.emplace_back(keys.size());
+                for (size_t i = 0; i < keys.size(); ++i) groups[0][i] = i;
+                return groups;
+            }
+            auto owners = slot_owners();
+            std::unordered_map<uint32_t, size_t> index; // 节点（退化时为槽位）-> 组下标
+            for (size_t i = 0; i < keys.size(); ++i) {
+                uint16_t slot = RedisKey::slot(keys[i]);
+                uint32_t owner = owners ? (*owners)[slot] : slot;
+                auto it = index.emplace(owner, groups.size()).first;
+                if (it->second == groups.size()) groups.emplace_back();
+                groups[it->second].push_back(i);
+            }
+            return groups;
+        }
+
+        // 流水线中出现 MOVED/ASK 等错误说明槽位分布已经变化，丢弃缓存，下次分组时重新获取
+        void invalidate_slots() {
+            std::unique_lock<std::mutex> lock(_slots_mtx);
+            _slots_expire = std::chrono::steady_clock::time_point();
+        }
+    private:
+        // 调用期间维护并发计数，结束时（包括抛出异常）记录耗时
+        class Timer 
+        {
+        public:
+            Timer(RedisClient *client, const std::string &cmd)
+                : _client(client)
+                , _recorder(client->recorder(cmd))
+                , _start(std::chrono::steady_clock::now())
+            {
+                _client->_concurrency << _client->_in_flight.fetch_add(1) + 1;
+            }
+            ~Timer() {
+                auto cost = std::chrono::steady_clock::now() - _start;
+                *_recorder << std::chrono::duration_cast<std::chrono::microseconds>(cost).count();
+                _client->_in_flight.fetch_sub(1);
+                if (std::uncaught_exceptions() > 0) _client->_errors << 1;
+            }
+        private:
+            RedisClient *_client;
+            bvar::LatencyRecorder *_recorder;
+            std::chrono::steady_clock::time_point _start;
+        };
+
+        // 获取命令对应的耗时统计，首次使用时创建并以 <prefix>_<cmd> 暴露
+        bvar::LatencyRecorder *recorder(const std::string &cmd) {
+            std::unique_lock<std::mutex> lock(_mtx);
+            auto &rec = _latency[cmd];
+            if (!rec) {
+                rec.reset(new bvar::LatencyRecorder());
+                rec->expose_as(_prefix, cmd);
+            }
+            return rec.get();
+        }
+
+        void expose() {
+            _in_flight_status.expose_as(_prefix, "in_flight");
+            _concurrency.expose_as(_prefix, "concurrency");
+            _errors.expose_as(_prefix, "errors");
+        }
+
+        static int get_in_flight(void *arg) {
+            return static_cast<RedisClient *>(arg)->_in_flight.load();
+        }
+
+        // 槽位 -> 节点编号（以主节点地址区分），没有节点负责的槽位为 UINT32_MAX；获取失败时返回空
+        std::shared_ptr<const std::vector<uint32_t>> slot_owners() {
+            std::unique_lock<std::mutex> lock(_slots_mtx);
+            auto now = std::chrono::steady_clock::now();
+            if (now < _slots_expire) return _slots;
+            // 获取期间其他调用继续使用旧的分布（或按槽位分组），避免同时发起多次 CLUSTER SLOTS
+            _slots_expire = now + kSlotsTTL;
+            lock.unlock();
+
+            std::shared_ptr<std::vector<uint32_t>> owners;
+            try {
+                auto node = _cluster->redis("slots", false);
+                auto reply = call("cluster_slots", [&](auto &) { return node.command("CLUSTER", "SLOTS"); });
+                owners = std::make_shared<std::vector<uint32_t>>(16384, UINT32_MAX);
+                std::unordered_map<std::string, uint32_t> nodes;
+                // 每一项为 [起始槽位, 结束槽位, [主节点地址, 端口, ...], 从节点...]
+                for (size_t i = 0; reply && i < reply->elements; ++i) {
+                    redisReply *range = reply->element[i];
+                    if (range->elements < 3 || range->element[2]->elements < 2) continue;
+                    redisReply *master = range->element[2];
+                    std::string addr = std::string(master->element[0]->str, master->element[0]->len) + ":" +
+                                       std::to_string(master->element[1]->integer);
+                    uint32_t id = nodes.emplace(addr, nodes.size()).first->second;
+                    for (long long s = range->element[0]->integer; s <= range->element[1]->integer && s < 16384; ++s)
+                        (*owners)[s] = id;
+                }
+            } catch (const sw::redis::Error &) {
+                owners.reset();
+            }
+            lock.lock();
+            _slots = owners;
+            if (!owners) _slots_expire = std::chrono::steady_clock::now() + std::chrono::seconds(1); // 稍后重试
+            return _slots;
+        }
+    private:
+        std::shared_ptr<sw::redis::Redis> _redis;
+        std::shared_ptr<sw::redis::RedisCluster> _cluster;
+
+        std::string _prefix;
+        std::mutex _mtx;
+        std::unordered_map<std::string, std::unique_ptr<bvar::LatencyRecorder>> _latency; // 各命令的耗时分布
+        std::atomic<int> _in_flight{0};                // 正在执行的命令数量
+        bvar::PassiveStatus<int> _in_flight_status;    // 当前并发度
+        bvar::IntRecorder _concurrency;                // 每次调用发起时的并发度，平均值接近连接池大小说明连接池不够用
+        bvar::Adder<int64_t> _errors;                  // 执行失败（抛出异常）的调用次数
+
+        std::mutex _slots_mtx;
+        std::shared_ptr<const std::vector<uint32_t>> _slots; // 集群槽位分布，见 slot_owners
+        std::chrono::steady_clock::time_point _slots_expire; // 槽位分布的过期时间
+    };
+
+    // 频道订阅线程：持续订阅 channel，每收到一条消息调用一次 on_message；连接出错时稍后重新订阅，重建订阅期间发布的消息会丢失
+    // 析构时设置停止标志，并向本对象专用的控制频道发布消息，唤醒阻塞在 consume 中的线程（读超时为 0 时 consume 不会自行返回），
+    // 再等待线程退出；Redis 不可用、无法唤醒时最多等待 stop_timeout，之后不再等待，线程在 consume 下次返回时自行退出
+    // on_message 在订阅线程中执行，不应捕获订阅者所有者的裸指针，析构期间以及放弃等待之后仍可能被调用
+    class RedisSubscriber
+    {
+    public:
+        using ptr = std::shared_ptr<RedisSubscriber>;
+        using MessageCallback = std::function<void(const std::string &)>;
+
+        RedisSubscriber(const RedisClient::ptr &redis_client,
+                        const std::string &channel,
+                        const MessageCallback &on_message,
+                        std::chrono::milliseconds stop_timeout = std::chrono::milliseconds(2000))
+            : _redis_client(redis_client)
+            , _control(channel + ":stop:" + std::to_string(std::random_device()()))
+            , _stop_timeout(stop_timeout)
+            , _state(std::make_shared<State>())
+        {
+            _thread = std::thread(run, _state, _redis_client, channel, _control, on_message);
+        }
+
+        ~RedisSubscriber() {
+            {
+                std::unique_lock<std::mutex> lock(_state->mtx);
+                _state->running = false;
+            }
+            _state->cond.notify_all();
+            auto deadline = std::chrono::steady_clock::now() + _stop_timeout;
+            std::unique_lock<std::mutex> lock(_state->mtx);
+            while (!_state->exited && std::chrono::steady_clock::now() < deadline) {
+                // 线程可能正在重建订阅、还没有订阅控制频道，因此周期性地重复发布，直到线程退出
+                lock.unlock();
+                try {
+                    _redis_client->call("publish", [&](auto &redis) { return redis.publish(_control, ""); });
+                } catch (const std::exception &e) {}
+                lock.lock();
+                _state->cond.wait_for(lock, std::chrono::milliseconds(100), [this]() { return _state->exited; });
+            }
+            bool exited = _state->exited;
+            lock.unlock();
+            if (exited) _thread.join();
+            else _thread.detach();
+        }
+    private:
+        // 订阅线程与本对象共享的状态，放弃等待后由线程继续持有
+        struct State
+        {
+            std::mutex mtx;
+            std::condition_variable cond;
+            bool running = true;  // 所有者是否仍需要订阅
+            bool exited = false;  // 订阅线程是否已退出
+        };
+
+        static bool active(const std::shared_ptr<State> &state) {
+            std::unique_lock<std::mutex> lock(state->mtx);
+            return state->running;
+        }
+
+        static void run(std::shared_ptr<State> state, RedisClient::ptr redis, std::string channel,
+                        std::string control, MessageCallback on_message) {
+            while (active(state)) {
+                try {
+                    auto sub = redis->call("subscribe", [](auto &r) { return r.subscriber(); });
+                    sub.on_message([&](std::string ch, std::string msg) {
+                        if (ch == channel) on_message(msg);
+                    });
+                    sub.subscribe(channel);
+                    sub.subscribe(control);
+                    while (active(state)) {
+                        // 读超时（socket_timeout）只说明这段时间没有消息，订阅连接仍然可用，继续等待
+                        try {
+                            sub.consume();
+                        } catch (const sw::redis::TimeoutError &e) {
+                            continue;
+                        }
+                    }
+                } catch (const std::exception &e) {
+                    // 连接断开等错误：稍后重新订阅，等待期间析构可以立即唤醒
+                    std::unique_lock<std::mutex> lock(state->mtx);
+                    state->cond.wait_for(lock, std::chrono::seconds(1), [&]() { return !state->running; });
+                }
+            }
+            {
+                std::unique_lock<std::mutex> lock(state->mtx);
+                state->exited = true;
+            }
+            state->cond.notify_all();
+        }
+    private:
+        RedisClient::ptr _redis_client;
+        std::string _control;                // 控制频道，析构时向其发布消息唤醒订阅线程
+        std::chrono::milliseconds _stop_timeout;
+        std::shared_ptr<State> _state;
+        std::thread _thread;
+    };
+
+    // 登录脚本的执行结果
+    enum class LoginResult 
+    {
+        OK = 0,            // 登录成功，会话与在线状态已写入
+        ALREADY_ONLINE = 1,// 用户已在其他地方登录
+        CODE_MISMATCH = 2  // 验证码错误或已过期
+    };
     // RedisClientFactory 类用于创建 Redis 客户端对象
     // 通过封装创建过程，简化外部调用时对 Redis 客户端的初始化
     class RedisClientFactory 
@@ -14,55 +397,486 @@ namespace liren
         //   - port: Redis 服务器端口
         //   - db: 使用的数据库编号
         //   - keep_alive: 是否启用长连接保持
+        //   - options: 连接池与超时参数
         // 返回值：
         //   - std::shared_ptr<sw::redis::Redis>：返回创建的 Redis 客户端智能指针
         static std::shared_ptr<sw::redis::Redis> create(const std::string &host,
                                                         int port,
                                                         int db,
-                                                        bool keep_alive) 
+                                                        bool keep_alive,
+                                                        const RedisOptions &options = RedisOptions()) 
         {
             // 配置连接选项
-            sw::redis::ConnectionOptions opts;
-            opts.host = host;         // 设置 Redis 服务器地址
-            opts.port = port;         // 设置 Redis 服务器端口
+            sw::redis::ConnectionOptions opts = connection_options(host, port, keep_alive, options);
             opts.db = db;             // 指定使用的数据库编号
-            opts.keep_alive = keep_alive; // 设置是否启用长连接保持
 
             // 创建 Redis 客户端对象，并封装到智能指针中返回
-            auto res = std::make_shared<sw::redis::Redis>(opts);
+            auto res = std::make_shared<sw::redis::Redis>(opts, pool_options(options));
             return res;
         }
+
+        // 创建 Redis Cluster 客户端：只需指定任意一个集群节点，客户端会自动获取槽位分布并按键路由
+        // 连接池参数作用于每一个集群节点
+        static std::shared_ptr<sw::redis::RedisCluster> create_cluster(const std::string &host,
+                                                                       int port,
+                                                                       bool keep_alive,
+                                                                       const RedisOptions &options = RedisOptions()) 
+        {
+            // 集群模式只支持 0 号库，不设置 db
+            sw::redis::ConnectionOptions opts = connection_options(host, port, keep_alive, options);
+            return std::make_shared<sw::redis::RedisCluster>(opts, pool_options(options));
+        }
+
+        // 按部署方式创建统一的 RedisClient
+        static RedisClient::ptr create_client(const std::string &host,
+                                              int port,
+                                              int db,
+                                              bool keep_alive,
+                                              bool cluster = false,
+                                              const RedisOptions &options = RedisOptions()) 
+        {
+            if (cluster) 
+                return std::make_shared<RedisClient>(create_cluster(host, port, keep_alive, options), options.metrics_prefix);
+            return std::make_shared<RedisClient>(create(host, port, db, keep_alive, options), options.metrics_prefix);
+        }
+    private:
+        static sw::redis::ConnectionOptions connection_options(const std::string &host,
+                                                               int port,
+                                                               bool keep_alive,
+                                                               const RedisOptions &options) 
+        {
+            sw::redis::ConnectionOptions opts;
+            opts.host = host;                             // 设置 Redis 服务器地址
+            opts.port = port;                             // 设置 Redis 服务器端口
+            opts.keep_alive = keep_alive;                 // 设置是否启用长连接保持
+            opts.connect_timeout = options.connect_timeout;
+            opts.socket_timeout = options.socket_timeout;
+            return opts;
+        }
+
+        static sw::redis::ConnectionPoolOptions pool_options(const RedisOptions &options) {
+            sw::redis::ConnectionPoolOptions pool;
+            pool.size = options.pool_size;
+            pool.wait_timeout = options.pool_wait_timeout;
+            pool.connection_lifetime = options.connection_lifetime;
+            return pool;
+        }
+    };
+
+    // 封装验证码操作
+    // 支持添加、删除验证码，并设置验证码的有效期（超时自动失效）
+    class Codes 
+    {
+    public:
+        using ptr = std::shared_ptr<Codes>;
+
+        // 构造函数：传入 Redis 客户端对象
+        Codes(const RedisClient::ptr &redis_client)
+            : _redis_client(redis_client) 
+        {}
+
+        // append 方法：添加验证码
+        // 参数：
+        //   - cid: 验证码对应的键（通常用于标识）
+        //   - code: 验证码内容
+        //   - t: 有效期，默认为 300000 毫秒（5 分钟）
+        void append(const std::string &cid, const std::string &code, 
+            const std::chrono::milliseconds &t = std::chrono::milliseconds(300000)) {
+            // 设置键值对，并带有超时时间 t
+            std::string key = RedisKey::code(cid);
+            _redis_client->call("code_set", [&](auto &redis) { return redis.set(key, code, t); });
+        }
+
+        // remove 方法：删除指定验证码记录
+        void remove(const std::string &cid) {
+            std::string key = RedisKey::code(cid);
+            _redis_client->call("code_del", [&](auto &redis) { return redis.del(key); });
+        }
+
+        // code 方法：根据验证码键(cid)获取验证码内容
+        // 返回类型为 sw::redis::OptionalString，用于判断是否成功获取验证码
+        sw::redis::OptionalString code(const std::string &cid)  {
+            std::string key = RedisKey::code(cid);
+            return _redis_client->call("code_get", [&](auto &redis) { return redis.get(key); });
+        }
+
+        // verify 方法：一次往返中校验验证码，校验通过则删除，保证同一验证码只能使用一次
+        bool verify(const std::string &cid, const std::string &code) {
+            static RedisScript script(
+                "local code = redis.call('GET', KEYS[1]) "
+                "if (not code) or code ~= ARGV[1] then return 0 end "
+                "redis.call('DEL', KEYS[1]) "
+                "return 1");
+            std::vector<std::string> keys = {RedisKey::code(cid)};
+            return _redis_client->call("code_verify", [&](auto &redis) {
+                return script.run<long long>(redis, keys, {code});
+            }) == 1;
+        }
+    private:
+        RedisClient::ptr _redis_client; // 保存 Redis 客户端对象，供验证码相关操作使用
+    };
+
+    // 会话管理的可选参数
+    struct SessionOptions 
+    {
+        std::chrono::milliseconds ttl{0};        // 会话有效期（滑动过期），0 表示永不过期
+        double refresh_ratio = 0.5;              // 距上次续期超过 ttl 的该比例后才再次续期，避免每次访问都续期
+        std::chrono::milliseconds cache_ttl{0};  // 进程内 ssid->uid 近端缓存的有效期，0 表示不缓存
+        size_t cache_capacity = 100000;          // 近端缓存的最大条目数
+        std::string invalidate_channel = "session_invalidate"; // 会话删除时广播失效通知的频道
+
+        std::string token_secret;                // 签名令牌密钥，非空时登录签发无状态令牌，校验令牌不访问 Redis
+        std::chrono::seconds token_ttl{7 * 24 * 3600}; // 令牌有效期（令牌过期时间固定，不随访问续期）
+        std::string revocation_key = "session_revoked"; // 已注销令牌的吊销列表（有序集合，分值为令牌过期时间）
+        std::chrono::milliseconds revocation_sync{1000}; // 本地吊销列表从 Redis 同步的间隔，即注销在其他进程生效的最大延迟
+    };
+
+    // 已注销令牌的吊销列表
+    // Redis 中以有序集合保存（成员为会话ID，分值为令牌过期时间），后台线程定期拉取未过期的部分到本地
+    // 令牌过期后不再需要吊销记录，列表大小只与有效期内的注销次数有关
+    // 构造时不访问 Redis：本地列表初始为空，由后台线程立即同步，失败时按同步间隔重试，
+    // 因此 Redis 不可用时服务仍能启动，只是在首次同步成功前其他进程的注销不会在本进程生效
+    class TokenRevocation 
+    {
+    public:
+        using ptr = std::shared_ptr<TokenRevocation>;
+
+        TokenRevocation(const RedisClient::ptr &redis_client,
+                        const std::string &key,
+                        std::chrono::milliseconds interval,
+                        const std::string &metrics_prefix = "token_revocation")
+            : _redis_client(redis_client)
+            , _key(key)
+            , _interval(interval)
+            , _staleness(get_staleness, this)
+            , _synced_at(std::chrono::steady_clock::now())
+            , _running(true)
+        {
+            _staleness.expose_as(metrics_prefix, "staleness_ms");
+            _sync_errors.expose_as(metrics_prefix, "sync_errors");
+            _thread = std::thread([this]() {
+                std::unique_lock<std::mutex> lock(_mtx);
+                while (_running) {
+                    lock.unlock();
+                    try {
+                        sync();
+                        if (_failures > 0) LOG_INFO("吊销列表 {} 恢复同步，此前连续失败 {} 次", _key, _failures);
+                        _failures = 0;
+                    } catch (const std::exception &e) {
+                        // Redis 不可用时保留上一次同步的结果，下个周期重试；
+                        // 首次失败立即告警，之后每 kWarnInterval 最多告警一次，避免 Redis 故障期间刷屏
+                        _sync_errors << 1;
+                        auto now = std::chrono::steady_clock::now();
+                        if (_failures++ == 0 || now - _warned_at >= kWarnInterval) {
+                            _warned_at = now;
+                            LOG_WARN("同步吊销列表 {} 失败（连续 {} 次，本地列表已 {} 毫秒未更新）：{}",
+                                     _key, _failures, get_staleness(this), e.what());
+                        }
+                    }
+                    lock.lock();
+                    _cond.wait_for(lock, _interval);
+                }
+            });
+        }
+        ~TokenRevocation() {
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                _running = false;
+            }
+            _cond.notify_all();
+            if (_thread.joinable()) _thread.join();
+        }
+
+        // 吊销会话ID对应的令牌，本进程立即生效，其他进程在下一次同步后生效
+        void revoke(const std::string &ssid, int64_t expire_at) {
+            _redis_client->call("token_revoke", [&](auto &redis) {
+                return redis.zadd(_key, ssid, static_cast<double>(expire_at));
+            });
+            std::unique_lock<std::shared_mutex> lock(_set_mtx);
+            _revoked.insert(ssid);
+        }
+
+        bool revoked(const std::string &ssid) {
+            std::shared_lock<std::shared_mutex> lock(_set_mtx);
+            return _revoked.count(ssid) > 0;
+        }
+    private:
+        // 清理已过期的吊销记录，并拉取全部未过期的记录替换本地列表
+        void sync() {
+            double now = static_cast<double>(time(nullptr));
+            std::unordered_set<std::string> revoked;
+            _redis_client->call("token_revocation_sync", [&](auto &redis) {
+                redis.zremrangebyscore(_key, sw::redis::RightBoundedInterval<double>(now, sw::redis::BoundType::CLOSED));
+                redis.zrangebyscore(_key, sw::redis::LeftBoundedInterval<double>(now, sw::redis::BoundType::OPEN),
+                    std::inserter(revoked, revoked.end()));
+            });
+            std::unique_lock<std::shared_mutex> lock(_set_mtx);
+            _revoked.swap(revoked);
+            _synced_at = std::chrono::steady_clock::now();
+        }
+
+        // 本地列表距上次同步成功的时间（毫秒），尚未同步成功时从构造开始计算；
+        // 持续超过同步间隔说明其他进程的注销没有在本进程生效
+        static int64_t get_staleness(void *arg) {
+            TokenRevocation *self = static_cast<TokenRevocation *>(arg);
+            std::shared_lock<std::shared_mutex> lock(self->_set_mtx);
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - self->_synced_at).count();
+        }
+
+        static constexpr std::chrono::seconds kWarnInterval{30};
+    private:
+        RedisClient::ptr _redis_client;
+        std::string _key;
+        std::chrono::milliseconds _interval;
+
+        bvar::PassiveStatus<int64_t> _staleness;  // 本地吊销列表的陈旧程度
+        bvar::Adder<int64_t> _sync_errors;        // 同步失败次数
+        // 以下两项只在同步线程中访问
+        int64_t _failures = 0;                    // 连续同步失败次数
+        std::chrono::steady_clock::time_point _warned_at; // 上次告警时间
+
+        std::shared_mutex _set_mtx;
+        std::unordered_set<std::string> _revoked; // 本地吊销列表
+        std::chrono::steady_clock::time_point _synced_at; // 上次同步成功的时间，由 _set_mtx 保护
+
+        bool _running;
+        std::mutex _mtx;
+        std::condition_variable _cond;
+        std::thread _thread;
     };
 
     // 封装基于 Redis 的会话管理操作
     // 用于保存和管理用户会话信息，支持添加、删除以及获取会话对应的用户ID
+    // 开启近端缓存后，uid 查询优先命中进程内缓存；会话删除时通过 Redis 发布订阅通知所有进程失效
+    // 配置了令牌密钥后，issue 为会话签发签名令牌，uid/remove 同时接受令牌与普通会话ID
     class Session 
     {
     public:
         using ptr = std::shared_ptr<Session>;
 
         // 构造函数：传入 Redis 客户端对象，用于后续操作 Redis 数据库
-        Session(const std::shared_ptr<sw::redis::Redis> &redis_client)
-            : _redis_client(redis_client) 
-        {}
+        Session(const RedisClient::ptr &redis_client,
+                const SessionOptions &options = SessionOptions())
+            : _redis_client(redis_client)
+            , _options(options)
+            , _cache(std::make_shared<NearCache>())
+        {
+            if (_options.cache_ttl.count() > 0) subscribe();
+            if (!_options.token_secret.empty()) {
+                // 令牌校验不访问 Redis，无法顺带续期；会话与在线状态至少保留到令牌过期
+                if (_options.ttl.count() > 0 && _options.ttl < _options.token_ttl) _options.ttl = _options.token_ttl;
+                _token = std::make_shared<SessionToken>(_options.token_secret);
+                _revocation = std::make_shared<TokenRevocation>(_redis_client,
+                    _options.revocation_key, _options.revocation_sync);
+            }
+        }
+
+        // issue 方法：返回交给客户端的会话凭证
+        // 启用令牌时为携带用户ID与过期时间的签名令牌，否则就是会话ID本身
+        std::string issue(const std::string &ssid, const std::string &uid) {
+            if (!_token) return ssid;
+            return _token->sign(uid, ssid, time(nullptr) + _options.token_ttl.count());
+        }
 
         // append 方法：为给定的会话ID(ssid)存储对应的用户ID(uid)
         void append(const std::string &ssid, const std::string &uid) {
-            _redis_client->set(ssid, uid);
+            std::string key = RedisKey::session(ssid);
+            _redis_client->call("session_set", [&](auto &redis) { return redis.set(key, uid, _options.ttl); });
+            cache_put(ssid, uid);
         }
 
-        // remove 方法：删除指定会话ID(ssid)对应的 Redis 键值对
-        void remove(const std::string &ssid) {
-            _redis_client->del(ssid);
+        // remove 方法：删除指定会话ID(ssid)对应的 Redis 键值对，并通知其他进程清除近端缓存
+        // 传入签名令牌时，将令牌加入吊销列表后删除其对应的会话；
+        // 已过期的令牌本身已经不能通过校验，不再加入吊销列表，但仍删除其对应的会话
+        // 返回 false 表示令牌签名无效，没有删除任何会话
+        bool remove(const std::string &ssid) {
+            SessionToken::Claims claims;
+            if (_token && SessionToken::is_token(ssid)) {
+                // 以 0 作为当前时间只校验签名，过期的令牌同样取出其中的会话ID
+                if (!_token->verify(ssid, claims, 0)) return false;
+                if (claims.expire_at > time(nullptr)) _revocation->revoke(claims.ssid, claims.expire_at);
+                return remove(claims.ssid);
+            }
+            _cache->erase(ssid);
+            std::string key = RedisKey::session(ssid);
+            if (_options.cache_ttl.count() == 0) {
+                _redis_client->call("session_del", [&](auto &redis) { return redis.del(key); });
+                return true;
+            }
+            _redis_client->call("session_del_publish", [&](auto &) {
+                return _redis_client->pipeline(RedisKey::hash_tag(key))
+                    .del(key)
+                    .publish(_options.invalidate_channel, ssid)
+                    .exec();
+            });
+            return true;
         }
 
         // uid 方法：根据会话ID(ssid)获取存储的用户ID
         // 返回类型为 sw::redis::OptionalString，可以判断是否存在该键
+        // 近端缓存命中时不访问 Redis；设置了有效期时，距上次续期较久才顺带续期会话与在线状态
+        // 传入签名令牌时只在本地校验签名、有效期与吊销列表，不访问 Redis
         sw::redis::OptionalString uid(const std::string &ssid) {
-            return _redis_client->get(ssid);
+            if (_token && SessionToken::is_token(ssid)) {
+                SessionToken::Claims claims;
+                if (!_token->verify(ssid, claims) || _revocation->revoked(claims.ssid)) return {};
+                return claims.uid;
+            }
+            auto now = std::chrono::steady_clock::now();
+            Entry entry;
+            bool found = _cache->get(ssid, entry);
+            bool need_refresh = _options.ttl.count() > 0 &&
+                (!found || now - entry.refreshed_at >= _options.ttl * _options.refresh_ratio);
+            if (found && now < entry.expire_at && !need_refresh) return entry.uid;
+
+            sw::redis::OptionalString res;
+            std::string key = RedisKey::session(ssid);
+            if (need_refresh) {
+                // KEYS[2] 为会话所属用户的在线状态键，会话ID不带用户哈希标签时由脚本根据会话值拼接（仅单机模式可用）
+                static RedisScript script(
+                    "local uid = redis.call('GET', KEYS[1]) "
+                    "if not uid then return false end "
+                    "redis.call('PEXPIRE', KEYS[1], ARGV[1]) "
+                    "redis.call('PEXPIRE', KEYS[2] or ('status:{' .. uid .. '}'), ARGV[1]) "
+                    "return uid");
+                std::vector<std::string> keys = {key};
+                std::string tag = RedisKey::hash_tag(ssid);
+                if (tag != ssid) keys.push_back(RedisKey::status(tag));
+                res = _redis_client->call("session_refresh", [&](auto &redis) {
+                    return script.run<sw::redis::OptionalString>(redis, keys, {std::to_string(_options.ttl.count())});
+                });
+            } else {
+                res = _redis_client->call("session_get", [&](auto &redis) { return redis.get(key); });
+            }
+            if (!res) _cache->erase(ssid);
+            else if (need_refresh || !found) cache_put(ssid, *res);
+            else cache_put(ssid, *res, entry.refreshed_at);
+            return res;
+        }
+
+        // login 方法：在一次往返中完成 "检查用户未登录 -> 创建会话 -> 标记在线"
+        // 由 Lua 脚本在 Redis 端原子执行，避免先检查再写入之间被并发登录插入
+        LoginResult login(const std::string &ssid, const std::string &uid) {
+            static RedisScript script(login_script());
+            std::vector<std::string> keys = {RedisKey::session(ssid), RedisKey::status(uid)};
+            long long ret = _redis_client->call("session_login", [&](auto &redis) {
+                return script.run<long long>(redis, keys, {uid, "", std::to_string(_options.ttl.count())});
+            });
+            if (ret == 0) cache_put(ssid, uid);
+            return static_cast<LoginResult>(ret);
+        }
+
+        // login 方法（带验证码）：在同一个脚本中先校验并删除验证码，再完成登录
+        // 集群模式下验证码键与会话键不在同一槽位，先单独原子地校验并删除验证码，再执行登录脚本
+        // 参数：
+        //   - cid: 验证码ID
+        //   - code: 用户提交的验证码
+        LoginResult login(const std::string &ssid, const std::string &uid,
+                          const std::string &cid, const std::string &code) {
+            if (_redis_client->cluster()) {
+                if (!Codes(_redis_client).verify(cid, code)) return LoginResult::CODE_MISMATCH;
+                return login(ssid, uid);
+            }
+            static RedisScript script(login_script());
+            std::vector<std::string> keys = {RedisKey::session(ssid), RedisKey::status(uid), RedisKey::code(cid)};
+            long long ret = _redis_client->call("session_login_code", [&](auto &redis) {
+                return script.run<long long>(redis, keys, {uid, code, std::to_string(_options.ttl.count())});
+            });
+            if (ret == 0) cache_put(ssid, uid);
+            return static_cast<LoginResult>(ret);
+        }
+    private:
+        // 近端缓存条目
+        struct Entry 
+        {
+            std::string uid;
+            std::chrono::steady_clock::time_point expire_at;    // 缓存过期时间
+            std::chrono::steady_clock::time_point refreshed_at; // 最近一次续期 Redis 有效期的时间
+        };
+
+        // 分段加锁的 ssid->uid 近端缓存，减少并发查询之间的锁竞争
+        class NearCache 
+        {
+        public:
+            bool get(const std::string &ssid, Entry &entry) {
+                Shard &shard = _shards[std::hash<std::string>()(ssid) % SHARDS];
+                std::unique_lock<std::mutex> lock(shard.mtx);
+                auto it = shard.entries.find(ssid);
+                if (it == shard.entries.end()) return false;
+                entry = it->second;
+                return true;
+            }
+            void put(const std::string &ssid, const Entry &entry, size_t capacity) {
+                Shard &shard = _shards[std::hash<std::string>()(ssid) % SHARDS];
+                std::unique_lock<std::mutex> lock(shard.mtx);
+                // 超出容量时淘汰任意一个条目，近端缓存的条目本身有效期很短，不需要严格的 LRU
+                if (shard.entries.size() >= capacity / SHARDS + 1 && shard.entries.count(ssid) == 0)
+                    shard.entries.erase(shard.entries.begin());
+                shard.entries[ssid] = entry;
+            }
+            void erase(const std::string &ssid) {
+                Shard &shard = _shards[std::hash<std::string>()(ssid) % SHARDS];
+                std::unique_lock<std::mutex> lock(shard.mtx);
+                shard.entries.erase(ssid);
+            }
+        private:
+            static const size_t SHARDS = 16;
+            struct Shard 
+            {
+                std::mutex mtx;
+                std::unordered_map<std::string, Entry> entries;
+            };
+            Shard _shards[SHARDS];
+        };
+
+        // 写入近端缓存；未设置 cache_ttl 时条目只用于记录续期时间，不会命中
+        void cache_put(const std::string &ssid, const std::string &uid,
+                       std::chrono::steady_clock::time_point refreshed_at = std::chrono::steady_clock::now()) {
+            if (_options.cache_ttl.count() == 0 && _options.ttl.count() == 0) return;
+            Entry entry;
+            entry.uid = uid;
+            entry.expire_at = std::chrono::steady_clock::now() + _options.cache_ttl;
+            entry.refreshed_at = refreshed_at;
+            _cache->put(ssid, entry, _options.cache_capacity);
+        }
+
+        // 订阅会话失效频道，收到其他进程的删除通知后清除本地缓存；订阅线程在 Session 析构时停止
+        void subscribe() {
+            std::weak_ptr<NearCache> weak = _cache;
+            _subscriber = std::make_shared<RedisSubscriber>(_redis_client, _options.invalidate_channel,
+                [weak](const std::string &ssid) {
+                    auto cache = weak.lock();
+                    if (cache) cache->erase(ssid);
+                });
+        }
+
+        // KEYS[1]: 会话ID, KEYS[2]: 用户在线状态键, KEYS[3]: 验证码ID（可选）
+        // ARGV[1]: 用户ID, ARGV[2]: 验证码（可选）, ARGV[3]: 有效期毫秒数（0 表示不过期）
+        static std::string login_script() {
+            return "if #KEYS == 3 then "
+                   "  local code = redis.call('GET', KEYS[3]) "
+                   "  if (not code) or code ~= ARGV[2] then return 2 end "
+                   "  redis.call('DEL', KEYS[3]) "
+                   "end "
+                   "if redis.call('EXISTS', KEYS[2]) == 1 then return 1 end "
+                   "local ttl = tonumber(ARGV[3]) "
+                   "if ttl > 0 then "
+                   "  redis.call('SET', KEYS[1], ARGV[1], 'PX', ttl) "
+                   "  redis.call('SET', KEYS[2], '', 'PX', ttl) "
+                   "else "
+                   "  redis.call('SET', KEYS[1], ARGV[1]) "
+                   "  redis.call('SET', KEYS[2], '') "
+                   "end "
+                   "return 0";
         }
     private:
-        std::shared_ptr<sw::redis::Redis> _redis_client; // 保存 Redis 客户端对象，所有 Redis 操作均通过此对象进行
+        RedisClient::ptr _redis_client;                  // 保存 Redis 客户端对象，所有 Redis 操作均通过此对象进行
+        SessionOptions _options;                         // 会话有效期与近端缓存参数
+        std::shared_ptr<NearCache> _cache;               // 进程内近端缓存
+        std::shared_ptr<SessionToken> _token;            // 令牌签发与校验，未配置密钥时为空
+        TokenRevocation::ptr _revocation;                // 已注销令牌的吊销列表
+        RedisSubscriber::ptr _subscriber;                // 会话失效频道的订阅线程，最先析构
     };
 
     // 封装用户在线状态的管理操作
@@ -73,66 +887,78 @@ namespace liren
         using ptr = std::shared_ptr<Status>;
 
         // 构造函数，传入 Redis 客户端对象
-        Status(const std::shared_ptr<sw::redis::Redis> &redis_client)
+        Status(const RedisClient::ptr &redis_client)
             : _redis_client(redis_client) 
         {}
 
         // append 方法：设置指定用户ID(uid)的在线状态
         // 这里使用空字符串作为在线状态的标记
         void append(const std::string &uid) {
-            _redis_client->set(uid, "");
+            std::string key = RedisKey::status(uid);
+            _redis_client->call("status_set", [&](auto &redis) { return redis.set(key, ""); });
         }
 
         // remove 方法：删除指定用户ID(uid)的在线状态记录
         void remove(const std::string &uid) {
-            _redis_client->del(uid);
+            std::string key = RedisKey::status(uid);
+            _redis_client->call("status_del", [&](auto &redis) { return redis.del(key); });
         }
 
         // exists 方法：检查指定用户ID(uid)是否存在在线状态记录
         // 通过获取键值判断是否存在
         bool exists(const std::string &uid) {
-            auto res = _redis_client->get(uid);
+            std::string key = RedisKey::status(uid);
+            auto res = _redis_client->call("status_get", [&](auto &redis) { return redis.get(key); });
             if (res) return true;
             return false;
         }
-    private:
-        std::shared_ptr<sw::redis::Redis> _redis_client; // Redis 客户端对象，用于执行状态相关的 Redis 操作
-    };
 
-    // 封装验证码操作
-    // 支持添加、删除验证码，并设置验证码的有效期（超时自动失效）
-    class Codes 
-    {
-    public:
-        using ptr = std::shared_ptr<Codes>;
-
-        // 构造函数：传入 Redis 客户端对象
-        Codes(const std::shared_ptr<sw::redis::Redis> &redis_client)
-            : _redis_client(redis_client) 
-        {}
-
-        // append 方法：添加验证码
-        // 参数：
-        //   - cid: 验证码对应的键（通常用于标识）
-        //   - code: 验证码内容
-        //   - t: 有效期，默认为 300000 毫秒（5 分钟）
-        void append(const std::string &cid, const std::string &code, 
-            const std::chrono::milliseconds &t = std::chrono::milliseconds(300000)) {
-            // 设置键值对，并带有超时时间 t
-            _redis_client->set(cid, code, t);
-        }
-
-        // remove 方法：删除指定验证码记录
-        void remove(const std::string &cid) {
-            _redis_client->del(cid);
-        }
-
-        // code 方法：根据验证码键(cid)获取验证码内容
-        // 返回类型为 sw::redis::OptionalString，用于判断是否成功获取验证码
-        sw::redis::OptionalString code(const std::string &cid)  {
-            return _redis_client->get(cid);
+        // exists_many 方法：批量检查多个用户的在线状态，返回结果与 uids 一一对应
+        // 单机模式下每 batch 个键合并为一条 MGET，渲染群成员/好友列表时只需一次往返
+        // 集群模式下各用户的状态键分布在不同槽位，无法合并为一条 MGET：按所在节点分组，每个节点每 batch 个键一条 GET 流水线，
+        // 往返次数与节点数相当；槽位迁移导致流水线中的命令出错时，刷新槽位分布并单独查询这些键（客户端会跟随重定向）
+        std::vector<bool> exists_many(const std::vector<std::string> &uids, size_t batch = 1000) {
+            std::vector<bool> res;
+            res.reserve(uids.size());
+            if (_redis_client->cluster()) {
+                res.assign(uids.size(), false);
+                std::vector<std::string> keys;
+                keys.reserve(uids.size());
+                for (auto &uid : uids) keys.push_back(RedisKey::status(uid));
+                for (auto &group : _redis_client->group_by_node(keys)) {
+                    for (size_t i = 0; i < group.size(); i += batch) {
+                        size_t end = std::min(group.size(), i + batch);
+                        auto replies = _redis_client->call("status_pipeline_get", [&](auto &) {
+                            auto pipe = _redis_client->pipeline(RedisKey::hash_tag(keys[group[i]]));
+                            for (size_t j = i; j < end; ++j) pipe.get(keys[group[j]]);
+                            return pipe.exec();
+                        });
+                        for (size_t j = i; j < end; ++j) {
+                            try {
+                                res[group[j]] = static_cast<bool>(replies.get<sw::redis::OptionalString>(j - i));
+                            } catch (const sw::redis::ReplyError &) {
+                                _redis_client->invalidate_slots();
+                                res[group[j]] = exists(uids[group[j]]);
+                            }
+                        }
+                    }
+                }
+                return res;
+            }
+            std::vector<std::string> keys;
+            std::vector<sw::redis::OptionalString> values;
+            for (size_t i = 0; i < uids.size(); i += batch) {
+                keys.clear();
+                values.clear();
+                for (size_t j = i; j < uids.size() && j < i + batch; ++j) keys.push_back(RedisKey::status(uids[j]));
+                _redis_client->call("status_mget", [&](auto &redis) {
+                    redis.mget(keys.begin(), keys.end(), std::back_inserter(values));
+                });
+                for (auto &v : values) res.push_back(static_cast<bool>(v));
+            }
+            return res;
         }
     private:
-        std::shared_ptr<sw::redis::Redis> _redis_client; // 保存 Redis 客户端对象，供验证码相关操作使用
+        RedisClient::ptr _redis_client; // Redis 客户端对象，用于执行状态相关的 Redis 操作
     };
 } 
@@ -201,6 +201,64 @@ namespace liren {
         std::shared_ptr<elasticlient::Client> _client;  // Elasticsearch 客户端
     };
 
+    // ESUpdate类用于对已有文档进行局部更新，只提交发生变化的字段
+    class ESUpdate 
+    {
+    public:
+        ESUpdate(std::shared_ptr<elasticlient::Client> &client, 
+                const std::string &name, 
+                const std::string &type = "_doc")
+            : _name(name)          
+            , _type(type)          
+            , _client(client)      
+        {}
+
+        // 追加需要更新的字段
+        template<typename T>
+        ESUpdate &append(const std::string &key, const T &val)
+        {
+            _doc[key] = val;
+            return *this;
+        }
+
+        // 更新指定ID的文档，文档不存在时返回 false，并在 missing 非空时将其置为 true
+        bool update(const std::string &id, bool *missing = nullptr) 
+        {
+            if (missing) *missing = false;
+            Json::Value root;
+            root["doc"] = _doc;  // 局部更新：只合并 doc 中的字段
+            std::string body;
+            bool ret = Serialize(root, body);
+            if (ret == false) { 
+                LOG_ERROR("索引序列化失败！");  
+                return false; 
+            }
+            try {
+                auto rsp = _client->performRequest(elasticlient::Client::HTTPMethod::POST,
+                    _name + "/" + _type + "/" + id + "/_update", body);
+                if (rsp.status_code == 404) {
+                    LOG_WARN("更新数据 {} 失败，文档不存在", id);
+                    if (missing) *missing = true;
+                    return false;
+                }
+                if (rsp.status_code < 200 || rsp.status_code >= 300) {
+                    LOG_ERROR("更新数据 {}-{} 失败，响应状态码异常: {}", id, body, rsp.status_code);  
+                    return false;  
+                }
+            } catch(std::exception &e) {  
+                LOG_ERROR("更新数据 {}-{} 失败: {}", id, body, e.what());  
+                return false;  
+            }
+            return true;  
+        }
+
+    private:
+        std::string _name;                 // 索引名称
+        std::string _type;                 // 索引类型
+        Json::Value _doc;                  // 需要更新的字段
+        std::shared_ptr<elasticlient::Client> _client;  // Elasticsearch 客户端
+    };
+
     class ESRemove {
     public:
         ESRemove(std::shared_ptr<elasticlient::Client> &client, 
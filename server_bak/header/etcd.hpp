@@ -4,23 +4,87 @@
 #include <etcd/Response.hpp>
 #include <etcd/Value.hpp>
 #include <etcd/Watcher.hpp>
+#include <json/json.h>
 #include <functional>
+#include <fstream>
+#include <cmath>
+#include <chrono>
+#include <sys/resource.h>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 #include "logger.hpp"
 
 namespace liren {
+    // 服务实例注册到etcd中的元数据，以JSON格式作为键值对的值
+    struct InstanceMeta {
+        std::string host;            // 实例的外部访问地址
+        int64_t weight = 100;        // 权重，硬件配置越高权重越大
+        std::string zone;            // 所在机房/机架
+        int32_t max_concurrency = 0; // 最大并发数，0表示不限制
+        std::string version;         // 构建版本
+        double load = 0;             // 当前负载（0~1），由实例周期性更新
+
+        std::string serialize() const
+        {
+            Json::Value root;
+            root["host"] = host;
+            root["weight"] = (Json::Int64)weight;
+            root["zone"] = zone;
+            root["max_concurrency"] = max_concurrency;
+            root["version"] = version;
+            root["load"] = load;
+            Json::StreamWriterBuilder swb;
+            swb["indentation"] = "";
+            return Json::writeString(swb, root);
+        }
+
+        // 解析注册的值：不是JSON对象时按照旧格式处理，即整个值就是访问地址
+        static InstanceMeta parse(const std::string& value)
+        {
+            InstanceMeta meta;
+            Json::Value root;
+            Json::CharReaderBuilder crb;
+            std::unique_ptr<Json::CharReader> cr(crb.newCharReader());
+            std::string err;
+            if(value.empty() || value[0] != '{' ||
+               cr->parse(value.data(), value.data() + value.size(), &root, &err) == false || !root.isObject())
+            {
+                meta.host = value;
+                return meta;
+            }
+            meta.host = root["host"].asString();
+            meta.weight = root.get("weight", 100).asInt64();
+            meta.zone = root["zone"].asString();
+            meta.max_concurrency = root["max_concurrency"].asInt();
+            meta.version = root["version"].asString();
+            meta.load = root["load"].asDouble();
+            return meta;
+        }
+    };
+
     class Registry 
     {
     public:
         using ptr = std::shared_ptr<Registry>;
+        using LoadCallback = std::function<double()>; // 获取当前负载（0~1）的回调
 
         // host：主机地址
         Registry(const std::string& host)
             : _client(std::make_shared<etcd::Client>(host))
             , _keepalive(_client->leasekeepalive(3).get())
             , _leaseid(_keepalive->Lease())
+            , _running(true)
         {}
 
         ~Registry() {
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                _running = false;
+            }
+            _cond.notify_all();
+            if(_load_thread.joinable()) _load_thread.join();
             _keepalive->Cancel();
         }
 
@@ -37,10 +101,76 @@ namespace liren {
             return true;
         }
 
+        // 以结构化元数据进行服务注册；load_cb不为空时，后台线程周期性地将最新负载更新到注册信息中
+        bool regiter(const std::string& key, const InstanceMeta& meta,
+                     const LoadCallback& load_cb = LoadCallback(), int interval_sec = 5)
+        {
+            if(regiter(key, meta.serialize()) == false) return false;
+            if(!load_cb) return true;
+            if(_load_thread.joinable()) {
+                LOG_WARN("负载上报线程已经启动，{} 不再上报负载", key);
+                return true;
+            }
+
+            _load_thread = std::thread([this, key, meta, load_cb, interval_sec]() {
+                InstanceMeta cur = meta;
+                std::unique_lock<std::mutex> lock(_mtx);
+                while(_running)
+                {
+                    _cond.wait_for(lock, std::chrono::seconds(interval_sec));
+                    if(!_running) break;
+                    lock.unlock();
+                    // 负载变化不明显时不更新，避免频繁触发所有消费者的监听回调
+                    double load = std::min(1.0, std::max(0.0, load_cb()));
+                    if(std::abs(load - cur.load) >= 0.05)
+                    {
+                        cur.load = load;
+                        regiter(key, cur.serialize());
+                    }
+                    lock.lock();
+                }
+            });
+            return true;
+        }
+
+        // 以进程CPU使用率作为负载：两次调用之间进程占用的CPU时间 / (经过的时间 × CPU核数)
+        static LoadCallback cpu_load()
+        {
+            auto last = std::make_shared<std::pair<int64_t, int64_t>>(cpu_time_us(), wall_time_us());
+            return [last]() {
+                int64_t cpu = cpu_time_us(), wall = wall_time_us();
+                int64_t elapsed = wall - last->second;
+                double cores = std::max(1u, std::thread::hardware_concurrency());
+                double load = elapsed > 0 ? (cpu - last->first) / (elapsed * cores) : 0;
+                *last = std::make_pair(cpu, wall);
+                return load;
+            };
+        }
+
+    private:
+        static int64_t cpu_time_us()
+        {
+            struct rusage usage;
+            getrusage(RUSAGE_SELF, &usage);
+            return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL +
+                usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+        }
+
+        static int64_t wall_time_us()
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
     private:
         std::shared_ptr<etcd::Client> _client;       // 客户端对象
         std::shared_ptr<etcd::KeepAlive> _keepalive; // 保活对象
         uint64_t _leaseid; // 租约id
+
+        bool _running;                  // 负载上报线程是否继续运行
+        std::mutex _mtx;
+        std::condition_variable _cond;
+        std::thread _load_thread;       // 负载上报线程
     };
 
 
@@ -53,37 +183,126 @@ namespace liren {
         Discovery(const std::string& host,      // 主机地址
                 const std::string& basedir,   // 表示主目录
                 const NotifyCallback& put_cb, // 新增键值对后的回调处理
-                const NotifyCallback& del_cb) // 删除键值对后的回调处理
+                const NotifyCallback& del_cb, // 删除键值对后的回调处理
+                const std::string& snapshot_file = "", // 本地快照文件，为空表示不使用快照
+                int timeout_ms = 3000)                 // 全量同步请求的超时时间（毫秒）
             : _client(std::make_shared<etcd::Client>(host))
+            , _basedir(basedir)
+            , _snapshot_file(snapshot_file)
             , _put_cb(put_cb)
             , _del_cb(del_cb)
+            , _revision(0)
+            , _running(true)
+            , _resync(false)
         {
-            // 1. 先进行服务发现，获取到当前已有的数据
-            auto resp = _client->ls(basedir).get();
-            if(resp.is_ok() == false) {
-                LOG_ERROR("获取键值对数据失败：{}", resp.error_message());
-            }
+            // 全量同步在后台线程中执行，etcd无响应时若不设置超时，析构时等待线程退出会一直阻塞
+            _client->set_grpc_timeout(std::chrono::milliseconds(timeout_ms));
 
-            // 对获取到的数据进行回调处理
-            for(int i = 0; i < resp.keys().size(); ++i) {
-                if(_put_cb) _put_cb(resp.key(i), resp.value(i).as_string());
+            // 1. 有本地快照时，先按照快照中的数据进行路由，不等待etcd，再在后台线程中从快照的版本号继续监听
+            if(load_snapshot())
+            {
+                LOG_INFO("从本地快照 {} 恢复了 {} 个服务节点，版本号：{}", _snapshot_file, _kvs.size(), _revision);
+                for(auto& kv : _kvs)
+                    if(_put_cb) _put_cb(kv.first, kv.second);
+                _sync_thread = std::thread(&Discovery::sync_loop, this);
+                return;
             }
 
-            // 2. 然后进行事件监控，监控数据发生的改变并调用回调进行处理
-            _watcher = std::make_shared<etcd::Watcher>(*_client.get(), basedir,
-                std::bind(&Discovery::callback, this, std::placeholders::_1), true);
+            // 2. 没有快照时，先进行服务发现，获取到当前已有的数据
+            full_sync();
+
+            // 3. 然后进行事件监控，监控数据发生的改变并调用回调进行处理
+            _sync_thread = std::thread(&Discovery::sync_loop, this);
         }
 
         ~Discovery() {
-            _watcher->Cancel();
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                _running = false;
+            }
+            _cond.notify_all();
+            _sync_thread.join();
+            if(_watcher) _watcher->Cancel();
         }
 
     private:
+        // 后台同步线程：从记录的版本号之后开始监听，监听出错（如版本号已被etcd压缩）时重新全量同步
+        void sync_loop()
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            int64_t from = _revision + 1;
+            lock.unlock();
+            watch(from);
+
+            lock.lock();
+            while(_running)
+            {
+                _cond.wait(lock, [this]() { return !_running || _resync; });
+                // 稍作等待再重试，避免etcd不可用时反复全量同步
+                _cond.wait_for(lock, std::chrono::seconds(1), [this]() { return !_running; });
+                if(!_running) break;
+                _resync = false;
+                lock.unlock();
+
+                LOG_WARN("{} 监听中断，重新进行全量同步", _basedir);
+                if(_watcher) _watcher->Cancel();
+                from = full_sync() + 1;
+                watch(from);
+                lock.lock();
+            }
+        }
+
+        // 从指定版本号开始监听，版本号未知时从当前最新版本开始监听
+        void watch(int64_t from)
+        {
+            auto cb = std::bind(&Discovery::callback, this, std::placeholders::_1);
+            if(from <= 1)
+                _watcher = std::make_shared<etcd::Watcher>(*_client.get(), _basedir, cb, true);
+            else
+                _watcher = std::make_shared<etcd::Watcher>(*_client.get(), _basedir, from, cb, true);
+        }
+
+        // 全量获取目录下的数据，与当前记录的数据比对后回调新增/删除，返回本次获取到的版本号
+        int64_t full_sync()
+        {
+            auto resp = _client->ls(_basedir).get();
+            if(resp.is_ok() == false) {
+                LOG_ERROR("获取键值对数据失败：{}", resp.error_message());
+                std::unique_lock<std::mutex> lock(_mtx);
+                return _revision;
+            }
+
+            std::map<std::string, std::string> kvs;
+            for(int i = 0; i < resp.keys().size(); ++i)
+                kvs[resp.key(i)] = resp.value(i).as_string();
+
+            std::map<std::string, std::string> old;
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                old.swap(_kvs);
+                _kvs = kvs;
+                _revision = resp.index();
+            }
+            for(auto& kv : old)
+            {
+                auto it = kvs.find(kv.first);
+                if(it == kvs.end() || host_changed(kv.second, it->second))
+                    if(_del_cb) _del_cb(kv.first, kv.second);
+            }
+            for(auto& kv : kvs)
+                if(_put_cb) _put_cb(kv.first, kv.second);
+            save_snapshot();
+            return resp.index();
+        }
+
         void callback(const etcd::Response& resp)
         {
             if(resp.is_ok() == false)
             {
                 LOG_ERROR("收到一个错误的事件通知：{}", resp.error_message())
+                std::unique_lock<std::mutex> lock(_mtx);
+                _resync = true;
+                _cond.notify_all();
                 return;
             }
 
@@ -92,21 +311,102 @@ namespace liren {
             {
                 if(es.event_type() == etcd::Event::EventType::PUT)
                 {
+                    std::string old;
+                    {
+                        std::unique_lock<std::mutex> lock(_mtx);
+                        std::string& value = _kvs[es.kv().key()];
+                        old.swap(value);
+                        value = es.kv().as_string();
+                        _revision = std::max<int64_t>(_revision, es.kv().modified_index());
+                    }
+                    // 同一个键换了访问地址时，先下线旧地址，否则旧节点会一直留在路由中
+                    if(!old.empty() && host_changed(old, es.kv().as_string()) && _del_cb)
+                        _del_cb(es.kv().key(), old);
                     if(_put_cb) _put_cb(es.kv().key(), es.kv().as_string());
                     LOG_DEBUG("新增服务：{}-{}", es.kv().key(), es.kv().as_string());
                 }
                 else if(es.event_type() == etcd::Event::EventType::DELETE_)
                 {
-                    if(_put_cb) _del_cb(es.prev_kv().key(), es.prev_kv().as_string());
+                    {
+                        std::unique_lock<std::mutex> lock(_mtx);
+                        _kvs.erase(es.prev_kv().key());
+                        _revision = std::max<int64_t>(_revision, es.kv().modified_index());
+                    }
+                    if(_del_cb) _del_cb(es.prev_kv().key(), es.prev_kv().as_string());
                     LOG_DEBUG("删除服务：{}-{}", es.prev_kv().key(), es.prev_kv().as_string());
                 }
             }
+            save_snapshot();
+        }
+
+        // 仅负载等元数据变化时不需要下线，重新上线即可更新
+        static bool host_changed(const std::string& old_value, const std::string& new_value)
+        {
+            return old_value != new_value &&
+                InstanceMeta::parse(old_value).host != InstanceMeta::parse(new_value).host;
+        }
+
+        // 快照文件格式：{"revision": 版本号, "kvs": {键: 值, ...}}
+        bool load_snapshot()
+        {
+            if(_snapshot_file.empty()) return false;
+            std::ifstream ifs(_snapshot_file);
+            if(ifs.is_open() == false) return false;
+
+            Json::Value root;
+            Json::CharReaderBuilder crb;
+            std::string err;
+            if(Json::parseFromStream(crb, ifs, &root, &err) == false || !root.isObject()) {
+                LOG_WARN("解析服务发现快照 {} 失败：{}", _snapshot_file, err);
+                return false;
+            }
+            std::unique_lock<std::mutex> lock(_mtx);
+            _revision = root["revision"].asInt64();
+            const Json::Value& kvs = root["kvs"];
+            for(auto it = kvs.begin(); it != kvs.end(); ++it)
+                _kvs[it.name()] = it->asString();
+            return true;
+        }
+
+        // 先写临时文件再重命名，保证快照文件不会因为进程中途退出而损坏
+        void save_snapshot()
+        {
+            if(_snapshot_file.empty()) return;
+            Json::Value root;
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                root["revision"] = (Json::Int64)_revision;
+                root["kvs"] = Json::Value(Json::objectValue);
+                for(auto& kv : _kvs) root["kvs"][kv.first] = kv.second;
+            }
+            std::string tmp = _snapshot_file + ".tmp";
+            std::ofstream ofs(tmp, std::ios::out | std::ios::trunc);
+            if(ofs.is_open() == false) {
+                LOG_ERROR("打开服务发现快照文件 {} 失败！", tmp);
+                return;
+            }
+            Json::StreamWriterBuilder swb;
+            swb["indentation"] = "";
+            ofs << Json::writeString(swb, root);
+            ofs.close();
+            if(ofs.good() == false || std::rename(tmp.c_str(), _snapshot_file.c_str()) != 0)
+                LOG_ERROR("写入服务发现快照文件 {} 失败！", _snapshot_file);
         }
 
     private:
         std::shared_ptr<etcd::Client> _client;   // 客户端对象
         std::shared_ptr<etcd::Watcher> _watcher; // 监听对象
+        std::string _basedir;                    // 监听的主目录
+        std::string _snapshot_file;              // 本地快照文件
 
         NotifyCallback _put_cb, _del_cb; // 两个回调函数
+
+        std::mutex _mtx;
+        std::condition_variable _cond;
+        std::map<std::string, std::string> _kvs; // 当前已知的键值对，用于写快照以及全量同步时比对
+        int64_t _revision;                       // 已处理到的etcd版本号
+        bool _running;                           // 后台同步线程是否继续运行
+        bool _resync;                            // 是否需要重新全量同步
+        std::thread _sync_thread;                // 后台同步线程
     };
 }
\ No newline at end of file
@@ -0,0 +1,206 @@
+#pragma once
+#include <bthread/countdown_event.h> // bthread 感知的等待：在 bthread 中等待只挂起当前 bthread，不占用工作线程
+#include <bvar/bvar.h>                // 排队与执行耗时统计
+#include <functional>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include "logger.hpp"
+
+namespace liren
+{
+    // Executor 的可选参数
+    struct ExecutorOptions
+    {
+        size_t threads = 4;                    // 线程数，执行数据库操作时与数据库连接池大小一致
+        size_t max_queue = 0;                  // 排队任务数上限，超过时提交失败（future 中为异常），0 表示不限制
+        std::string metrics_prefix = "executor"; // bvar 指标名称前缀
+    };
+
+    // 执行结果，get 在结果就绪前挂起调用方
+    // 在 bthread 中调用 get 只挂起当前 bthread，brpc 工作线程可以继续处理其他请求
+    template <typename T>
+    class ExecFuture
+    {
+    public:
+        struct State
+        {
+            bthread::CountdownEvent event{1};
+            T value{};
+            std::exception_ptr error;
+        };
+
+        explicit ExecFuture(const std::shared_ptr<State> &state) : _state(state) {}
+
+        // 等待任务完成并返回结果，任务抛出的异常在这里重新抛出
+        T get() {
+            _state->event.wait();
+            if (_state->error) std::rethrow_exception(_state->error);
+            return std::move(_state->value);
+        }
+    private:
+        std::shared_ptr<State> _state;
+    };
+
+    template <>
+    class ExecFuture<void>
+    {
+    public:
+        struct State
+        {
+            bthread::CountdownEvent event{1};
+            std::exception_ptr error;
+        };
+
+        explicit ExecFuture(const std::shared_ptr<State> &state) : _state(state) {}
+
+        void get() {
+            _state->event.wait();
+            if (_state->error) std::rethrow_exception(_state->error);
+        }
+    private:
+        std::shared_ptr<State> _state;
+    };
+
+    // 阻塞 I/O 执行器：固定数量的 pthread 线程执行会阻塞在系统调用上的操作（如 MySQL 客户端调用）
+    // brpc 的处理函数运行在 bthread 中，直接执行阻塞调用会占住 bthread 工作线程，
+    // rpc_threads 较小时少量慢查询就会让整个服务失去响应；交给执行器后只有发起调用的 bthread 被挂起
+    class Executor
+    {
+    public:
+        using ptr = std::shared_ptr<Executor>;
+
+        explicit Executor(const ExecutorOptions &options = ExecutorOptions())
+            : _options(options)
+            , _queue_size(get_queue_size, this)
+            , _busy(get_busy, this)
+        {
+            if (_options.threads == 0) _options.threads = 1;
+            _queue_size.expose_as(_options.metrics_prefix, "queue_size");
+            _busy.expose_as(_options.metrics_prefix, "busy_threads");
+            _queue_wait.expose_as(_options.metrics_prefix, "queue_wait");
+            _exec_time.expose_as(_options.metrics_prefix, "exec_time");
+            _rejected.expose_as(_options.metrics_prefix, "rejected");
+            for (size_t i = 0; i < _options.threads; ++i) {
+                _threads.emplace_back([this]() { work(); });
+            }
+        }
+
+        // 析构时执行完已排队的任务再退出
+        ~Executor() {
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                _stop = true;
+            }
+            _cond.notify_all();
+            for (auto &thread : _threads) thread.join();
+        }
+
+        // 提交任务，返回的 future 在任务完成后就绪
+        template <typename F>
+        auto submit(F &&f) -> ExecFuture<decltype(f())>
+        {
+            using R = decltype(f());
+            auto state = std::make_shared<typename ExecFuture<R>::State>();
+            Task task;
+            task.enqueue_at = std::chrono::steady_clock::now();
+            // 任务保存在 std::function 中，要求可拷贝；用 shared_ptr 持有调用对象以支持只能移动的 lambda
+            auto fn = std::make_shared<typename std::decay<F>::type>(std::forward<F>(f));
+            task.fn = [state, fn]() {
+                try {
+                    set_value(*state, *fn);
+                } catch (...) {
+                    state->error = std::current_exception();
+                }
+                state->event.signal();
+            };
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                if (_stop || (_options.max_queue > 0 && _tasks.size() >= _options.max_queue)) {
+                    lock.unlock();
+                    _rejected << 1;
+                    state->error = std::make_exception_ptr(std::runtime_error("执行器已停止或队列已满"));
+                    state->event.signal();
+                    return ExecFuture<R>(state);
+                }
+                _tasks.push_back(std::move(task));
+            }
+            _cond.notify_one();
+            return ExecFuture<R>(state);
+        }
+
+        // 提交任务并等待结果
+        template <typename F>
+        auto run(F &&f) -> decltype(f())
+        {
+            return submit(std::forward<F>(f)).get();
+        }
+
+        size_t threads() const { return _options.threads; }
+
+    private:
+        struct Task
+        {
+            std::function<void()> fn;
+            std::chrono::steady_clock::time_point enqueue_at;
+        };
+
+        template <typename T, typename F>
+        static void set_value(T &state, F &f) { state.value = f(); }
+        template <typename F>
+        static void set_value(typename ExecFuture<void>::State &state, F &f) { f(); }
+
+        void work() {
+            while (true) {
+                Task task;
+                {
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    _cond.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+                    if (_tasks.empty()) return;
+                    task = std::move(_tasks.front());
+                    _tasks.pop_front();
+                    ++_running;
+                }
+                auto start = std::chrono::steady_clock::now();
+                _queue_wait << std::chrono::duration_cast<std::chrono::microseconds>(start - task.enqueue_at).count();
+                task.fn();
+                _exec_time << std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+                std::unique_lock<std::mutex> lock(_mtx);
+                --_running;
+            }
+        }
+
+        static size_t get_queue_size(void *arg) {
+            Executor *executor = static_cast<Executor *>(arg);
+            std::unique_lock<std::mutex> lock(executor->_mtx);
+            return executor->_tasks.size();
+        }
+        static size_t get_busy(void *arg) {
+            Executor *executor = static_cast<Executor *>(arg);
+            std::unique_lock<std::mutex> lock(executor->_mtx);
+            return executor->_running;
+        }
+    private:
+        ExecutorOptions _options;
+        std::mutex _mtx;
+        std::condition_variable _cond;
+        std::deque<Task> _tasks;  // 等待执行的任务
+        size_t _running = 0;      // 正在执行任务的线程数
+        bool _stop = false;
+        std::vector<std::thread> _threads;
+
+        bvar::PassiveStatus<size_t> _queue_size; // 当前排队任务数
+        bvar::PassiveStatus<size_t> _busy;       // 当前正在执行任务的线程数
+        bvar::LatencyRecorder _queue_wait;       // 任务从提交到开始执行的等待时间
+        bvar::LatencyRecorder _exec_time;        // 任务执行耗时
+        bvar::Adder<int64_t> _rejected;          // 因队列已满被拒绝的任务数
+    };
+}
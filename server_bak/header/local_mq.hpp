@@ -0,0 +1,443 @@
+#pragma once
+#include <queue>
+#include <deque>
+#include <unordered_map>
+#include <chrono>
+#include <exception>
+#include "rabbitmq.hpp"
+
+namespace liren {
+    // LocalMQ 的可选参数
+    struct LocalMQOptions
+    {
+        size_t publish_latency_us = 0; // 模拟发布方到服务器的耗时：消息提交后经过该时间才进入队列，发布完成回调随后调用
+        size_t deliver_latency_us = 0; // 模拟服务器到消费方的耗时：消息出队后经过该时间才交给消费回调
+    };
+
+    // 进程内的消息队列，用于在单机上离线压测生产者与消费者
+    // 与 RabbitMQ 保持相同的语义：
+    //   1. 交换机按类型路由：direct 精确匹配路由键，fanout 投递到全部绑定队列，topic 支持 * 与 # 通配；
+    //      空名称的默认交换机直接投递到与路由键同名的队列；没有匹配队列的消息被丢弃，发布仍视为成功
+    //   2. 同一队列的多个消费者轮流接收消息，每个消费者未确认的消息数不超过 prefetch
+    //   3. 回调正常返回后消息被确认；回调抛出异常时消息放回队列头部重新投递
+    //   4. consume_workers 为 0 时回调在投递线程中执行，否则按顺序键（默认为路由键）分发到处理线程，同一顺序键的消息按顺序处理
+    // 全部事件按到期时间排序、由同一个投递线程执行；处理线程执行完回调后，确认或重新投递同样作为事件交回投递线程，
+    // 因此除订阅时的首次投递外，消息出队、确认与重新投递都在投递线程中进行
+    // consume_workers 为 0 时相同延迟下的处理顺序是确定的；使用处理线程时，不同路由键的消息之间、
+    // 以及回调完成与新消息到达之间的先后取决于回调的实际耗时，只保证同一路由键内的顺序
+    class LocalMQ : public MessageQueue
+    {
+    public:
+        using ptr = std::shared_ptr<LocalMQ>;
+        using MessageQueue::publish_async;
+
+        // 运行统计
+        struct Stats
+        {
+            size_t published = 0;   // 已进入队列的消息数（投递到多个队列时按队列计数）
+            size_t unroutable = 0;  // 没有匹配队列而被丢弃的消息数
+            size_t delivered = 0;   // 已投递给消费者的消息数（含重新投递）
+            size_t acked = 0;       // 已确认的消息数
+            size_t redelivered = 0; // 重新投递的消息数
+        };
+
+        LocalMQ(const MQOptions &options = MQOptions(), const LocalMQOptions &local = LocalMQOptions())
+            : _options(options)
+            , _local(local)
+        {
+            for (size_t i = 0; i < _options.consume_workers; ++i) {
+                _workers.emplace_back(new Worker());
+                Worker *worker = _workers.back().get();
+                worker->thread = std::thread([this, worker]() { work(worker); });
+            }
+            _thread = std::thread([this]() { run(); });
+        }
+
+        // 停止投递线程与处理线程，尚未完成的发布以失败结束，尚未处理的消息被丢弃
+        ~LocalMQ()
+        {
+            {
+                std::unique_lock<std::mutex> lock(_event_mtx);
+                _stop = true;
+            }
+            _event_cond.notify_all();
+            _thread.join();
+            // 投递线程已退出，剩余事件以失败结束；此后登记的事件在 schedule 中直接以失败结束，处理线程中的同步发布不会一直等待
+            while (!_events.empty()) {
+                auto fn = _events.top().fn;
+                _events.pop();
+                fn(false);
+            }
+            for (auto &worker : _workers) {
+                {
+                    std::unique_lock<std::mutex> lock(worker->mtx);
+                    worker->stop = true;
+                }
+                worker->cond.notify_all();
+                worker->thread.join();
+            }
+        }
+
+        // 声明交换机、队列及绑定，重复声明是幂等的；交换机已存在但类型不同时声明失败
+        void declareComponents(const std::string &exchange,
+                               const std::string &queue,
+                               const std::string &routing_key = "routing_key",
+                               AMQP::ExchangeType echange_type = AMQP::ExchangeType::direct) override
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            auto it = _exchanges.find(exchange);
+            if (it != _exchanges.end() && it->second.type != echange_type) {
+                LOG_ERROR("声明 {} 交换机失败: 交换机已存在且类型不同", exchange);
+                return;
+            }
+            Exchange &ex = _exchanges[exchange];
+            ex.type = echange_type;
+            if (_queues.find(queue) == _queues.end()) _queues[queue].reset(new Queue());
+            auto binding = std::make_pair(queue, routing_key);
+            if (std::find(ex.bindings.begin(), ex.bindings.end(), binding) == ex.bindings.end()) {
+                ex.bindings.push_back(binding);
+            }
+            LOG_DEBUG("{} - {} 绑定成功！", exchange, queue);
+        }
+
+        // 发布消息并等待消息进入队列
+        // 在投递线程中（如 consume_workers 为 0 时的消费回调内）调用时不能等待，提交即返回
+        bool publish(const std::string &exchange,
+                     const std::string &msg,
+                     const std::string &routing_key = "routing_key") override
+        {
+            if (std::this_thread::get_id() == _thread.get_id()) {
+                publish_async(exchange, msg, routing_key, nullptr);
+                return true;
+            }
+            return publish_async(exchange, msg, routing_key).get();
+        }
+
+        // 异步发布消息，消息进入队列后在投递线程中调用 cb，交换机不存在时以失败结束
+        // 未完成的消息数达到 max_in_flight 时阻塞，等待超过 publish_timeout_ms 时以失败结束，与 MQClient 的背压行为一致
+        void publish_async(const std::string &exchange,
+                           const std::string &msg,
+                           const std::string &routing_key,
+                           const PublishCallback &cb) override
+        {
+            if (!acquire()) {
+                LOG_ERROR("{} 发布消息失败：等待在途名额超时", exchange);
+                if (cb) cb(false);
+                return;
+            }
+            schedule(_local.publish_latency_us, [this, exchange, msg, routing_key, cb](bool run) {
+                finish(cb, run && route(exchange, msg, routing_key));
+            });
+        }
+
+        // 从指定队列消费消息，队列不存在时订阅失败
+        void consume(const std::string &queue, const MessageCallback &cb) override
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            auto it = _queues.find(queue);
+            if (it == _queues.end()) {
+                LOG_ERROR("订阅 {} 队列消息失败: 队列不存在", queue);
+                return;
+            }
+            it->second->consumers.emplace_back(new Consumer{cb});
+            dispatch(it->second.get());
+        }
+
+        // 队列中等待投递的消息数
+        size_t depth(const std::string &queue) {
+            std::unique_lock<std::mutex> lock(_mtx);
+            auto it = _queues.find(queue);
+            return it == _queues.end() ? 0 : it->second->ready.size();
+        }
+
+        Stats stats() {
+            std::unique_lock<std::mutex> lock(_mtx);
+            return _stats;
+        }
+
+    private:
+        struct Message
+        {
+            std::string body;
+            std::string routing_key;
+        };
+        struct Consumer
+        {
+            MessageCallback cb;
+            size_t unacked = 0;      // 已投递、尚未确认的消息数
+        };
+        struct Queue
+        {
+            std::deque<Message> ready;                         // 等待投递的消息
+            std::vector<std::unique_ptr<Consumer>> consumers;
+            size_t next = 0;                                   // 下一次轮询投递的起始消费者
+        };
+        struct Exchange
+        {
+            AMQP::ExchangeType type = AMQP::ExchangeType::direct;
+            std::vector<std::pair<std::string, std::string>> bindings; // （队列名称，绑定键）
+        };
+        struct Event
+        {
+            std::chrono::steady_clock::time_point due;
+            uint64_t seq;
+            std::function<void(bool)> fn; // 参数为 false 表示客户端正在销毁，事件不再执行
+            bool operator>(const Event &other) const {
+                return due != other.due ? due > other.due : seq > other.seq;
+            }
+        };
+        struct Job
+        {
+            Queue *queue;
+            Consumer *consumer;
+            Message msg;
+        };
+        struct Worker
+        {
+            std::thread thread;
+            std::mutex mtx;
+            std::condition_variable cond;
+            std::deque<Job> jobs;
+            bool stop = false;
+        };
+
+        // 按交换机类型把消息放入匹配的队列
+        bool route(const std::string &exchange, const std::string &msg, const std::string &routing_key) {
+            std::unique_lock<std::mutex> lock(_mtx);
+            std::vector<Queue *> targets;
+            if (exchange.empty()) {
+                auto it = _queues.find(routing_key);
+                if (it != _queues.end()) targets.push_back(it->second.get());
+            } else {
+                auto it = _exchanges.find(exchange);
+                if (it == _exchanges.end()) {
+                    LOG_ERROR("发布消息失败: {} 交换机不存在", exchange);
+                    return false;
+                }
+                for (auto &binding : it->second.bindings) {
+                    if (!match(it->second.type, binding.second, routing_key)) continue;
+                    Queue *queue = _queues[binding.first].get();
+                    // 同一队列通过多个绑定匹配时只投递一次
+                    if (std::find(targets.begin(), targets.end(), queue) == targets.end()) targets.push_back(queue);
+                }
+            }
+            if (targets.empty()) ++_stats.unroutable;
+            for (Queue *queue : targets) {
+                queue->ready.push_back(Message{msg, routing_key});
+                ++_stats.published;
+                dispatch(queue);
+            }
+            return true;
+        }
+
+        // 判断路由键是否匹配绑定键；headers 等其他类型不检查路由键，按 fanout 处理
+        static bool match(AMQP::ExchangeType type, const std::string &binding_key, const std::string &routing_key) {
+            if (type == AMQP::ExchangeType::direct) return binding_key == routing_key;
+            if (type == AMQP::ExchangeType::topic) return match_topic(split(binding_key), 0, split(routing_key), 0);
+            return true;
+        }
+
+        // topic 匹配：以 . 分隔单词，* 匹配一个单词，# 匹配零个或多个单词
+        static bool match_topic(const std::vector<std::string> &pattern, size_t pi,
+                                const std::vector<std::string> &words, size_t wi) {
+            if (pi == pattern.size()) return wi == words.size();
+            if (pattern[pi] == "#") {
+                for (size_t i = wi; i <= words.size(); ++i) {
+                    if (match_topic(pattern, pi + 1, words, i)) return true;
+                }
+                return false;
+            }
+            if (wi == words.size()) return false;
+            if (pattern[pi] != "*" && pattern[pi] != words[wi]) return false;
+            return match_topic(pattern, pi + 1, words, wi + 1);
+        }
+
+        static std::vector<std::string> split(const std::string &key) {
+            std::vector<std::string> words;
+            size_t start = 0;
+            while (true) {
+                size_t pos = key.find('.', start);
+                words.push_back(key.substr(start, pos - start));
+                if (pos == std::string::npos) break;
+                start = pos + 1;
+            }
+            return words;
+        }
+
+        // 在持有 _mtx 时调用：把就绪的消息轮流投递给还有预取余量的消费者
+        void dispatch(Queue *queue) {
+            size_t n = queue->consumers.size();
+            while (!queue->ready.empty() && n > 0) {
+                Consumer *consumer = nullptr;
+                for (size_t i = 0; i < n; ++i) {
+                    Consumer *c = queue->consumers[(queue->next + i) % n].get();
+                    if (_options.prefetch == 0 || c->unacked < _options.prefetch) {
+                        consumer = c;
+                        queue->next = (queue->next + i + 1) % n;
+                        break;
+                    }
+                }
+                if (consumer == nullptr) return;
+                ++consumer->unacked;
+                ++_stats.delivered;
+                auto msg = std::make_shared<Message>(std::move(queue->ready.front()));
+                queue->ready.pop_front();
+                schedule(_local.deliver_latency_us, [this, queue, consumer, msg](bool run) {
+                    if (run) deliver(Job{queue, consumer, std::move(*msg)});
+                });
+            }
+        }
+
+        // 在投递线程中把消息交给消费回调或处理线程
+        void deliver(Job job) {
+            if (_workers.empty()) {
+                handle(job);
+                return;
+            }
+            // 与 MQClient 相同：按顺序键（默认为路由键的哈希值）选择处理线程
+            size_t key = _options.order_key ?
+                _options.order_key(job.msg.routing_key, job.msg.body.data(), job.msg.body.size()) :
+                std::hash<std::string>()(job.msg.routing_key);
+            Worker *worker = _workers[key % _workers.size()].get();
+            {
+                std::unique_lock<std::mutex> lock(worker->mtx);
+                worker->jobs.push_back(std::move(job));
+            }
+            worker->cond.notify_one();
+        }
+
+        // 在投递线程中执行消费回调并确认
+        void handle(Job &job) {
+            settle(job, invoke(job));
+        }
+
+        // 执行消费回调，正常返回时返回 true，抛出异常时返回 false
+        static bool invoke(Job &job) {
+            bool ok = true;
+            try {
+                job.consumer->cb(job.msg.body.data(), job.msg.body.size());
+            } catch (const std::exception &e) {
+                LOG_WARN("消息处理失败，重新投递: {}", e.what());
+                ok = false;
+            } catch (...) {
+                LOG_WARN("消息处理失败，重新投递");
+                ok = false;
+            }
+            return ok;
+        }
+
+        // 在投递线程中结束一条消息：ok 为 true 时确认，否则放回队列头部重新投递
+        void settle(Job &job, bool ok) {
+            std::unique_lock<std::mutex> lock(_mtx);
+            --job.consumer->unacked;
+            if (ok) {
+                ++_stats.acked;
+            } else {
+                ++_stats.redelivered;
+                job.queue->ready.push_front(std::move(job.msg));
+            }
+            dispatch(job.queue);
+        }
+
+        void work(Worker *worker) {
+            while (true) {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(worker->mtx);
+                    worker->cond.wait(lock, [worker]() { return worker->stop || !worker->jobs.empty(); });
+                    if (worker->stop) return;
+                    job = std::move(worker->jobs.front());
+                    worker->jobs.pop_front();
+                }
+                bool ok = invoke(job);
+                auto done = std::make_shared<Job>(std::move(job));
+                schedule(0, [this, done, ok](bool run) {
+                    if (run) settle(*done, ok);
+                });
+            }
+        }
+
+        // 登记一个延迟执行的事件
+        void schedule(size_t delay_us, std::function<void(bool)> fn) {
+            {
+                std::unique_lock<std::mutex> lock(_event_mtx);
+                if (_stop) {
+                    lock.unlock();
+                    fn(false);
+                    return;
+                }
+                _events.push(Event{std::chrono::steady_clock::now() + std::chrono::microseconds(delay_us), _seq++, std::move(fn)});
+            }
+            _event_cond.notify_one();
+        }
+
+        // 投递线程：按到期时间依次执行事件
+        void run() {
+            std::unique_lock<std::mutex> lock(_event_mtx);
+            while (!_stop) {
+                if (_events.empty()) {
+                    _event_cond.wait(lock);
+                    continue;
+                }
+                // 复制到期时间：等待期间其他线程插入事件会使堆重新分配，引用会失效
+                auto due = _events.top().due;
+                if (due > std::chrono::steady_clock::now()) {
+                    _event_cond.wait_until(lock, due);
+                    continue;
+                }
+                auto fn = _events.top().fn;
+                _events.pop();
+                lock.unlock();
+                fn(true);
+                lock.lock();
+            }
+        }
+
+        // 占用一个在途名额，名额用尽时等待，等待超过 publish_timeout_ms 时返回 false；投递线程不能等待，只计数
+        bool acquire() {
+            std::unique_lock<std::mutex> lock(_window_mtx);
+            if (_options.max_in_flight > 0 && std::this_thread::get_id() != _thread.get_id()) {
+                auto ready = [this]() { return _in_flight < _options.max_in_flight; };
+                if (_options.publish_timeout_ms <= 0) {
+                    _window_cond.wait(lock, ready);
+                } else if (!_window_cond.wait_for(lock, std::chrono::milliseconds(_options.publish_timeout_ms), ready)) {
+                    return false;
+                }
+            }
+            ++_in_flight;
+            return true;
+        }
+
+        // 消息完成：通知调用方并释放在途名额
+        void finish(const PublishCallback &cb, bool ret) {
+            if (cb) cb(ret);
+            {
+                std::unique_lock<std::mutex> lock(_window_mtx);
+                --_in_flight;
+            }
+            _window_cond.notify_one();
+        }
+
+    private:
+        MQOptions _options;
+        LocalMQOptions _local;
+
+        std::mutex _mtx;                                                  // 保护交换机、队列与统计信息
+        std::unordered_map<std::string, Exchange> _exchanges;
+        std::unordered_map<std::string, std::unique_ptr<Queue>> _queues;
+        Stats _stats;
+
+        std::mutex _event_mtx;
+        std::condition_variable _event_cond;
+        std::priority_queue<Event, std::vector<Event>, std::greater<Event>> _events; // 按到期时间排序的待执行事件
+        uint64_t _seq = 0;                                                // 事件登记序号，到期时间相同的事件按登记顺序执行
+        bool _stop = false;
+
+        std::mutex _window_mtx;
+        std::condition_variable _window_cond;
+        size_t _in_flight = 0;                            // 已提交但尚未完成的消息数
+
+        std::vector<std::unique_ptr<Worker>> _workers;    // 消息处理线程
+        std::thread _thread;                              // 投递线程
+    };
+}
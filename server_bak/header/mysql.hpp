@@ -5,10 +5,359 @@
 #include <iostream>   
 #include <odb/database.hxx>      // ODB ORM 框架中数据库抽象层定义
 #include <odb/mysql/database.hxx> // ODB MySQL 数据库实现的定义
+#include <odb/mysql/connection.hxx> // 取得底层 MYSQL 句柄，用于查询复制延迟
+#include <odb/mysql/mysql.hxx>      // MySQL C API
+#include <bvar/bvar.h>              // 复制延迟与读请求路由统计
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstring>
 #include "logger.hpp"  // 日志模块封装，用于输出调试和错误日志
 
 namespace liren 
 {
+    // ODBCluster 的可选参数
+    struct ODBClusterOptions 
+    {
+        int max_lag_sec = 1;                            // 复制延迟超过该秒数的从库不再承担读请求
+        std::chrono::milliseconds lag_check_interval{1000}; // 检查从库复制延迟的间隔
+        std::chrono::milliseconds pin_ttl{2000};        // 写入后该键的读请求固定走主库的时长，0 表示不固定
+        std::string metrics_prefix = "mysql";           // bvar 指标名称前缀
+    };
+
+    // ODBCluster 类管理一个主库与多个只读从库，每个库拥有独立的连接池
+    //   1. 写操作使用 primary()；读操作使用 reader()，在延迟正常的从库之间轮流分配
+    //   2. 后台线程定期查询每个从库的复制延迟，延迟超过 max_lag_sec、复制中断或查询失败的从库被跳过
+    //   3. 读写一致：写入后调用 pin(key)，pin_ttl 内以该键读取时固定走主库，避免读到写入之前的旧数据
+    //      固定只在当前进程内有效
+    // 没有可用从库时读请求回到主库
+    class ODBCluster 
+    {
+    public:
+        using ptr = std::shared_ptr<ODBCluster>;
+        using DB = std::shared_ptr<odb::core::database>;
+
+        ODBCluster(const DB &primary,
+                   const std::vector<DB> &replicas = std::vector<DB>(),
+                   const ODBClusterOptions &options = ODBClusterOptions())
+            : _primary(primary)
+            , _options(options)
+        {
+            _primary_reads.expose_as(_options.metrics_prefix, "primary_reads");
+            _replica_reads.expose_as(_options.metrics_prefix, "replica_reads");
+            for (size_t i = 0; i < replicas.size(); ++i) {
+                _replicas.emplace_back(new Replica(replicas[i]));
+                _replicas.back()->lag.expose_as(_options.metrics_prefix, "replica" + std::to_string(i) + "_lag");
+            }
+            if (!_replicas.empty()) {
+                check();
+                _checker = std::thread([this]() { run(); });
+            }
+        }
+
+        ~ODBCluster() {
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                _stop = true;
+            }
+            _cond.notify_all();
+            if (_checker.joinable()) _checker.join();
+        }
+
+        // 主库：所有写操作以及需要最新数据的读操作
+        const DB &primary() const { return _primary; }
+
+        // 读库：key 在写入后的固定时间窗口内，或没有可用从库时返回主库
+        const DB &reader(const std::string &key = std::string()) {
+            if (!_replicas.empty() && !(key.size() > 0 && pinned(key))) {
+                size_t n = _replicas.size();
+                size_t start = _next.fetch_add(1);
+                for (size_t i = 0; i < n; ++i) {
+                    Replica *replica = _replicas[(start + i) % n].get();
+                    if (replica->healthy) {
+                        _replica_reads << 1;
+                        return replica->db;
+                    }
+                }
+            }
+            _primary_reads << 1;
+            return _primary;
+        }
+
+        // 以 keys 中任意一个键读取时，只要其中有键被固定就走主库
+        const DB &reader(const std::vector<std::string> &keys) {
+            for (auto &key : keys) {
+                if (pinned(key)) return reader(key);
+            }
+            return reader();
+        }
+
+        // 标记 key 刚刚发生写入
+        void pin(const std::string &key) {
+            if (_options.pin_ttl.count() == 0 || _replicas.empty()) return;
+            std::unique_lock<std::mutex> lock(_pin_mtx);
+            _pins[key] = std::chrono::steady_clock::now() + _options.pin_ttl;
+        }
+
+    private:
+        struct Replica 
+        {
+            explicit Replica(const DB &d) : db(d) {}
+            DB db;
+            std::atomic<bool> healthy{true}; // 复制延迟是否在允许范围内
+            bvar::Status<int64_t> lag{-1};   // 最近一次查询到的复制延迟（秒），-1 表示复制中断或查询失败
+        };
+
+        bool pinned(const std::string &key) {
+            if (_options.pin_ttl.count() == 0) return false;
+            std::unique_lock<std::mutex> lock(_pin_mtx);
+            auto it = _pins.find(key);
+            if (it == _pins.end()) return false;
+            if (std::chrono::steady_clock::now() < it->second) return true;
+            _pins.erase(it);
+            return false;
+        }
+
+        // 清理已过期的固定记录，避免只写不读的键一直占用内存
+        void sweep() {
+            auto now = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> lock(_pin_mtx);
+            for (auto it = _pins.begin(); it != _pins.end();) {
+                if (now >= it->second) it = _pins.erase(it);
+                else ++it;
+            }
+        }
+
+        void run() {
+            std::unique_lock<std::mutex> lock(_mtx);
+            while (!_cond.wait_for(lock, _options.lag_check_interval, [this]() { return _stop; })) {
+                lock.unlock();
+                check();
+                sweep();
+                lock.lock();
+            }
+        }
+
+        void check() {
+            for (auto &replica : _replicas) {
+                int64_t lag = query_lag(replica->db);
+                replica->lag.set_value(lag);
+                bool healthy = lag >= 0 && lag <= _options.max_lag_sec;
+                if (replica->healthy.exchange(healthy) != healthy) {
+                    if (healthy) {
+                        LOG_INFO("从库复制延迟恢复正常: {} 秒", lag);
+                    } else {
+                        LOG_WARN("从库复制延迟过大或复制中断: {}，暂停向其分配读请求", lag);
+                    }
+                }
+            }
+        }
+
+        // 查询从库的复制延迟（秒），复制中断或查询失败时返回 -1
+        // MySQL 8.0.22 起使用 SHOW REPLICA STATUS/Seconds_Behind_Source，旧版本使用 SHOW SLAVE STATUS/Seconds_Behind_Master
+        static int64_t query_lag(const DB &db) {
+            try {
+                odb::mysql::connection_ptr conn(static_cast<odb::mysql::database &>(*db).connection());
+                MYSQL *handle = conn->handle();
+                if (mysql_query(handle, "SHOW REPLICA STATUS") != 0 &&
+                    mysql_query(handle, "SHOW SLAVE STATUS") != 0) {
+                    LOG_ERROR("查询从库复制状态失败: {}", mysql_error(handle));
+                    return -1;
+                }
+                MYSQL_RES *res = mysql_store_result(handle);
+                if (res == nullptr) return -1;
+                int64_t lag = -1;
+                MYSQL_ROW row = mysql_fetch_row(res);
+                unsigned int count = mysql_num_fields(res);
+                MYSQL_FIELD *fields = mysql_fetch_fields(res);
+                for (unsigned int i = 0; row != nullptr && i < count; ++i) {
+                    std::string name = fields[i].name;
+                    if (name != "Seconds_Behind_Source" && name != "Seconds_Behind_Master") continue;
+                    if (row[i] != nullptr) lag = std::atoll(row[i]);
+                    break;
+                }
+                mysql_free_result(res);
+                return lag;
+            } catch (const std::exception &e) {
+                LOG_ERROR("查询从库复制状态失败: {}", e.what());
+                return -1;
+            }
+        }
+    private:
+        DB _primary;
+        std::vector<std::unique_ptr<Replica>> _replicas;
+        ODBClusterOptions _options;
+        std::atomic<size_t> _next{0};      // 轮流分配读请求的起始从库
+
+        std::mutex _pin_mtx;
+        std::unordered_map<std::string, std::chrono::steady_clock::time_point> _pins; // 键 -> 固定走主库的截止时间
+
+        std::mutex _mtx;
+        std::condition_variable _cond;
+        bool _stop = false;
+        std::thread _checker;              // 复制延迟检查线程
+
+        bvar::Adder<int64_t> _primary_reads;  // 走主库的读请求数
+        bvar::Adder<int64_t> _replica_reads;  // 走从库的读请求数
+    };
+
+    // PreparedStmt 类通过 MySQL C API 执行预编译语句，用于 ODB 映射之外的单字段更新与全局索引表读写
+    //   1. 同一条 SQL 在每个连接上只准备一次，之后只绑定参数执行，参数不拼接进 SQL 文本
+    //   2. 参数与结果均按字符串绑定；查询只支持返回单个字符串值
+    //   3. 以 MYSQL 句柄区分连接：连接关闭后句柄地址可能被新连接复用，同时记录服务端连接ID，不一致时重新准备
+    //   4. 连接断开等客户端错误时丢弃该连接上缓存的全部语句
+    // 同一时刻一个连接只被一个线程使用，只有查找连接的缓存条目时需要加锁
+    class PreparedStmt 
+    {
+    public:
+        // 取得 handle 所在连接上 sql 的预编译语句，首次使用时准备，准备失败时 execute/query_value 返回 false
+        PreparedStmt(MYSQL *handle, const std::string &sql)
+            : _handle(handle)
+        {
+            Conn &conn = connection(handle);
+            auto it = conn.stmts.find(sql);
+            if (it != conn.stmts.end()) {
+                _stmt = it->second;
+                return;
+            }
+            MYSQL_STMT *stmt = mysql_stmt_init(handle);
+            if (!stmt) {
+                _errno = mysql_errno(handle);
+                _error = mysql_error(handle);
+                return;
+            }
+            if (mysql_stmt_prepare(stmt, sql.c_str(), sql.size()) != 0) {
+                _errno = mysql_stmt_errno(stmt);
+                _error = mysql_stmt_error(stmt);
+                mysql_stmt_close(stmt);
+                if (_errno >= CLIENT_ERROR_MIN) evict(handle);
+                return;
+            }
+            conn.stmts.emplace(sql, stmt);
+            _stmt = stmt;
+        }
+
+        // 绑定参数并执行，params 依次对应语句中的 ?
+        bool execute(const std::vector<std::string> &params) {
+            if (!_stmt) return false;
+            std::vector<MYSQL_BIND> binds(params.size());
+            std::vector<unsigned long> lengths(params.size());
+            for (size_t i = 0; i < params.size(); ++i) {
+                memset(&binds[i], 0, sizeof(MYSQL_BIND));
+                lengths[i] = params[i].size();
+                binds[i].buffer_type = MYSQL_TYPE_STRING;
+                binds[i].buffer = const_cast<char *>(params[i].data());
+                binds[i].buffer_length = lengths[i];
+                binds[i].length = &lengths[i];
+            }
+            if (!binds.empty() && mysql_stmt_bind_param(_stmt, binds.data()) != 0) return fail();
+            if (mysql_stmt_execute(_stmt) != 0) return fail();
+            return true;
+        }
+
+        // 执行返回单个字符串值的查询，found 表示是否有结果行，值为 NULL 时 value 为空
+        bool query_value(const std::vector<std::string> &params, std::string &value, bool &found) {
+            value.clear();
+            found = false;
+            if (!execute(params)) return false;
+            MYSQL_BIND bind;
+            unsigned long length = 0;
+            my_bool is_null = 0;
+            memset(&bind, 0, sizeof(bind));
+            bind.buffer_type = MYSQL_TYPE_STRING;
+            bind.length = &length;
+            bind.is_null = &is_null;
+            if (mysql_stmt_store_result(_stmt) != 0 || mysql_stmt_bind_result(_stmt, &bind) != 0) return fail();
+            // 先不提供缓冲区取得值的长度，再按长度读取该列
+            int rc = mysql_stmt_fetch(_stmt);
+            bool ok = rc != 1;
+            if (ok && rc != MYSQL_NO_DATA) {
+                found = true;
+                if (!is_null && length > 0) {
+                    value.resize(length);
+                    bind.buffer = &value[0];
+                    bind.buffer_length = length;
+                    ok = mysql_stmt_fetch_column(_stmt, &bind, 0, 0) == 0;
+                }
+            }
+            if (!ok) return fail();
+            mysql_stmt_free_result(_stmt);
+            return true;
+        }
+
+        // 最近一次执行的 INSERT/UPDATE/DELETE 影响的行数
+        unsigned long long affected_rows() { return _stmt ? mysql_stmt_affected_rows(_stmt) : 0; }
+        // 最近一次失败的错误码与错误信息
+        unsigned int error_code() const { return _errno; }
+        const std::string &error() const { return _error; }
+
+    private:
+        struct Conn
+        {
+            unsigned long thread_id = 0;                          // 服务端连接ID
+            std::unordered_map<std::string, MYSQL_STMT *> stmts;  // SQL -> 预编译语句
+        };
+
+        // 记录错误并释放可能残留的结果集
+        bool fail() {
+            _errno = mysql_stmt_errno(_stmt);
+            _error = mysql_stmt_error(_stmt);
+            mysql_stmt_free_result(_stmt);
+            if (_errno >= CLIENT_ERROR_MIN) {
+                evict(_handle);
+                _stmt = nullptr;
+            }
+            return false;
+        }
+
+        static std::mutex &mutex() {
+            static std::mutex mtx;
+            return mtx;
+        }
+        static std::unordered_map<MYSQL *, Conn> &conns() {
+            static std::unordered_map<MYSQL *, Conn> conns;
+            return conns;
+        }
+
+        // 取得连接的缓存条目：条目只会被持有该连接的线程修改或删除，解锁后引用仍然有效
+        static Conn &connection(MYSQL *handle) {
+            Conn *conn;
+            {
+                std::unique_lock<std::mutex> lock(mutex());
+                conn = &conns()[handle];
+            }
+            unsigned long id = mysql_thread_id(handle);
+            if (conn->thread_id != id) {
+                // 句柄地址被新连接复用：原连接关闭时其上的语句已与句柄分离，这里只释放内存
+                for (auto &item : conn->stmts) mysql_stmt_close(item.second);
+                conn->stmts.clear();
+                conn->thread_id = id;
+            }
+            return *conn;
+        }
+
+        static void evict(MYSQL *handle) {
+            std::unique_lock<std::mutex> lock(mutex());
+            auto it = conns().find(handle);
+            if (it == conns().end()) return;
+            for (auto &item : it->second.stmts) mysql_stmt_close(item.second);
+            conns().erase(it);
+        }
+
+    private:
+        static const unsigned int CLIENT_ERROR_MIN = 2000; // 客户端错误码（CR_*）起始值，如连接断开
+
+        MYSQL *_handle;
+        MYSQL_STMT *_stmt = nullptr;
+        unsigned int _errno = 0;
+        std::string _error;
+    };
+
     // ODBFactory 类封装了 ODB 数据库对象的创建逻辑
     // 通过该工厂方法可以创建 MySQL 数据库连接，并支持连接池功能
     class ODBFactory 
@@ -47,5 +396,56 @@ namespace liren
             
             return res;
         }
+
+        // 创建主库与只读从库组成的集群，每个库使用各自的连接池
+        // replica_hosts 中每一项为 "host" 或 "host:port"，未指定端口时与主库相同
+        static std::shared_ptr<ODBCluster> create_cluster(const std::string &user,
+                                                          const std::string &pswd,
+                                                          const std::string &host,
+                                                          const std::vector<std::string> &replica_hosts,
+                                                          const std::string &db,
+                                                          const std::string &cset,
+                                                          int port,
+                                                          int conn_pool_count,
+                                                          const ODBClusterOptions &options = ODBClusterOptions())
+        {
+            std::vector<std::shared_ptr<odb::core::database>> replicas;
+            for (const auto &replica : replica_hosts) {
+                size_t pos = replica.rfind(':');
+                if (pos == std::string::npos) {
+                    replicas.push_back(create(user, pswd, replica, db, cset, port, conn_pool_count));
+                } else {
+                    replicas.push_back(create(user, pswd, replica.substr(0, pos), db, cset,
+                                              std::stoi(replica.substr(pos + 1)), conn_pool_count));
+                }
+            }
+            return std::make_shared<ODBCluster>(create(user, pswd, host, db, cset, port, conn_pool_count),
+                                                replicas, options);
+        }
+
+        // 创建一个不带从库的集群，address 为 "host/db" 或 "host:port/db"，未指定端口时使用 port
+        // 用于用户表的其余分片以及全局索引库
+        static std::shared_ptr<ODBCluster> create_cluster(const std::string &user,
+                                                          const std::string &pswd,
+                                                          const std::string &address,
+                                                          const std::string &cset,
+                                                          int port,
+                                                          int conn_pool_count,
+                                                          const ODBClusterOptions &options = ODBClusterOptions())
+        {
+            size_t slash = address.find('/');
+            if (slash == std::string::npos) {
+                throw std::invalid_argument("数据库地址缺少库名称: " + address);
+            }
+            std::string host = address.substr(0, slash);
+            std::string db = address.substr(slash + 1);
+            size_t pos = host.rfind(':');
+            if (pos != std::string::npos) {
+                port = std::stoi(host.substr(pos + 1));
+                host = host.substr(0, pos);
+            }
+            return std::make_shared<ODBCluster>(create(user, pswd, host, db, cset, port, conn_pool_count),
+                                                std::vector<std::shared_ptr<odb::core::database>>(), options);
+        }
     };
 }
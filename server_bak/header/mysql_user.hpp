@@ -1,158 +1,699 @@
+#pragma once
 #include "mysql.hpp"         // MySQL 数据库相关头文件（封装了 MySQL 连接和操作）
 #include "user.hxx"          // 用户实体类声明
 #include "user-odb.hxx"      // 用户实体类的 ODB 映射声明
+#include "executor.hpp"      // 阻塞 I/O 执行器
+#include <unordered_set>
+#include <algorithm>
+#include <iterator>
+#include <cstdio>
 
 // 业务功能包括：
 //  用户注册、用户登录、验证码获取、手机号注册、手机号登录、获取用户信息、用户信息修改等
 //  同时支持通过昵称、手机号、用户ID以及多个用户ID获取用户信息
 
-namespace liren 
+namespace liren
 {
+    // 单字段更新的结果
+    enum class UpdateResult
+    {
+        OK,         // 更新成功（包括新值与旧值相同）
+        NOT_FOUND,  // 用户ID不存在
+        CONFLICT,   // 新值与其他用户的唯一索引字段（昵称、手机号）冲突
+        FAILED      // 数据库错误
+    };
+
     // UserTable 类封装了对用户表的数据库操作，提供插入、更新以及多种查询接口
-    class UserTable 
+    //
+    // 水平分片：用户记录按 user_id 的哈希值分布到 N 个库（每个库是一个 ODBCluster，可带只读从库）
+    //   1. 按用户ID的读写只访问所在分片，批量查询按分片分组后并行查询再合并
+    //   2. 昵称、手机号在各分片内的唯一索引无法保证全局唯一，也无法定位分片，
+    //      因此另设全局索引表 user_nickname_index / user_phone_index（键 -> 用户ID），存放在索引库中
+    //   3. 写入时先在分片主库开启事务并锁定（或插入）用户行，持有行锁期间在索引表登记新值（主键冲突即为重复），
+    //      再写用户表并提交，最后删除旧值；同一用户的昵称、手机号修改因行锁串行执行
+    //   4. 中途失败、删除旧值失败等会留下用户已不再使用的索引行：登记遇到冲突时锁定占用者的用户行（NOWAIT），
+    //      其当前值已不是该键时接管索引行；占用者正在写入（行被锁定）时按冲突处理
+    //      查询时同样以用户表为准过滤，reshard 工具的 index 模式可以批量清理
+    // 只有一个分片时不使用索引表，行为与未分片时相同
+    class UserTable
     {
     public:
         using ptr = std::shared_ptr<UserTable>;
+        using ChangeCallback = std::function<void(const std::string &)>; // 用户记录变更回调，参数为用户ID
 
-        // 构造函数：通过传入的数据库对象初始化 UserTable
-        UserTable(const std::shared_ptr<odb::core::database> &db)
-            : _db(db)
+        // 全局索引表：表名与键字段名
+        struct Index
+        {
+            const char *table;
+            const char *column;
+        };
+        static constexpr Index NICKNAME_INDEX{"user_nickname_index", "nickname"};
+        static constexpr Index PHONE_INDEX{"user_phone_index", "phone"};
+
+        // 构造函数：通过传入的数据库对象初始化 UserTable，读写都使用该数据库
+        UserTable(const std::shared_ptr<odb::core::database> &db,
+                  const Executor::ptr &executor = nullptr)
+            : UserTable(std::vector<ODBCluster::ptr>{std::make_shared<ODBCluster>(db)}, nullptr, executor)
         {}
 
-        // 插入用户记录
-        // 参数：user - 需要插入的用户对象（以智能指针形式传入）
-        // 返回值：成功返回 true，失败返回 false
-        bool insert(const std::shared_ptr<User> &user) 
+        // 构造函数：写操作使用主库，查询使用从库
+        // 写入成功后以用户ID、昵称、手机号固定走主库一段时间，随后按这些键的查询能读到刚写入的数据
+        // executor 非空时，数据库操作在执行器线程中执行，不占用 brpc 的 bthread 工作线程
+        UserTable(const ODBCluster::ptr &cluster,
+                  const Executor::ptr &executor = nullptr)
+            : UserTable(std::vector<ODBCluster::ptr>{cluster}, nullptr, executor)
+        {}
+
+        // 构造函数：用户表分布在 shards 中的多个库上，index 为全局索引表所在的库
+        // 多个分片且 index 为空时，索引表放在第一个分片中；索引表需要事先通过 create_index 创建
+        // 分片数量与顺序决定了用户所在的分片，变更时需要先用 reshard 工具迁移数据
+        UserTable(const std::vector<ODBCluster::ptr> &shards,
+                  const ODBCluster::ptr &index,
+                  const Executor::ptr &executor = nullptr)
+            : _shards(shards)
+            , _index(index)
+            , _executor(executor)
         {
+            if (!_index && _shards.size() > 1) _index = _shards[0];
+        }
+
+        // 用户ID所在的分片下标
+        // 使用 FNV-1a 哈希而不是 std::hash：分布需要在不同进程、不同编译器之间保持一致
+        static size_t shard_of(const std::string &uid, size_t count) {
+            uint64_t hash = 14695981039346656037ULL;
+            for (unsigned char c : uid) {
+                hash ^= c;
+                hash *= 1099511628211ULL;
+            }
+            return hash % count;
+        }
+
+        // 在索引库中创建全局索引表（已存在时不做修改）
+        static bool create_index(const ODBCluster::DB &db) {
             try {
-                odb::transaction trans(_db->begin()); // 开启一个数据库事务，确保操作的原子性
-                _db->persist(*user); // 持久化用户对象，将其写入数据库
-                trans.commit();      // 提交事务，保存数据
+                odb::mysql::connection_ptr conn(connect(db));
+                MYSQL *handle = conn->handle();
+                for (const Index *index : {&NICKNAME_INDEX, &PHONE_INDEX}) {
+                    std::string sql = std::string("CREATE TABLE IF NOT EXISTS `") + index->table + "` (`" +
+                        index->column + "` varchar(64) NOT NULL PRIMARY KEY, "
+                        "`user_id` varchar(64) NOT NULL, INDEX `user_id_i` (`user_id`)) ENGINE=InnoDB";
+                    if (mysql_real_query(handle, sql.c_str(), sql.size()) != 0) {
+                        LOG_ERROR("创建全局索引表 {} 失败:{}！", index->table, mysql_error(handle));
+                        return false;
+                    }
+                }
             } catch (std::exception &e) {
-                LOG_ERROR("新增用户失败 {}:{}！", user->nickname(), e.what());
+                LOG_ERROR("创建全局索引表失败:{}！", e.what());
                 return false;
             }
             return true;
         }
 
+        // 注册用户记录变更回调：insert/update 提交成功后调用，用于清除用户缓存
+        // 需要在开始处理请求之前注册
+        void on_change(const ChangeCallback &cb) { _on_change = cb; }
+
+        // 插入用户记录
+        // 参数：user - 需要插入的用户对象（以智能指针形式传入）
+        // 返回值：成功返回 true，失败返回 false
+        bool insert(const std::shared_ptr<User> &user)
+        {
+            std::string uid = user->user_id();
+            bool ret = run([&]() {
+                try {
+                    auto &db = cluster(uid)->primary();
+                    odb::transaction trans(db->begin()); // 开启一个数据库事务，确保操作的原子性
+                    db->persist(*user); // 持久化用户对象，将其写入数据库
+                    // 分片部署下在提交前登记全局索引：未提交的用户行持有锁，其他用户此时无法接管这些索引行
+                    // 昵称或手机号已被占用时回滚，不写入用户表
+                    if (_index) {
+                        if (index_add(NICKNAME_INDEX, user->nickname(), uid) != UpdateResult::OK) return false;
+                        if (index_add(PHONE_INDEX, user->phone(), uid) != UpdateResult::OK) {
+                            index_del(NICKNAME_INDEX, user->nickname(), uid);
+                            return false;
+                        }
+                    }
+                    try {
+                        trans.commit();      // 提交事务，保存数据
+                    } catch (...) {
+                        if (_index) {
+                            index_del(NICKNAME_INDEX, user->nickname(), uid);
+                            index_del(PHONE_INDEX, user->phone(), uid);
+                        }
+                        throw;
+                    }
+                } catch (std::exception &e) {
+                    LOG_ERROR("新增用户失败 {}:{}！", user->nickname(), e.what());
+                    return false;
+                }
+                return true;
+            });
+            if (!ret) return false;
+            pin(user);
+            if (_on_change) _on_change(uid); // 清除该用户ID的不存在缓存
+            return true;
+        }
+
         // 更新用户记录
         // 参数：user - 需要更新的用户对象
         // 返回值：成功返回 true，失败返回 false
-        bool update(const std::shared_ptr<User> &user) 
+        bool update(const std::shared_ptr<User> &user)
         {
-            try {
-                odb::transaction trans(_db->begin());
-                _db->update(*user); // 更新用户对象数据
-                trans.commit();
-            } catch (std::exception &e) {
-                LOG_ERROR("更新用户失败 {}:{}！", user->nickname(), e.what());
-                return false;
-            }
+            std::string uid = user->user_id();
+            bool ret = run([&]() {
+                std::vector<std::pair<const Index *, std::string>> added; // 本次登记的索引：失败时撤销
+                try {
+                    auto &db = cluster(uid)->primary();
+                    odb::transaction trans(db->begin());
+                    // 分片部署下锁定用户行并读取旧值，昵称、手机号有变化时先登记新值，提交后删除旧值
+                    std::shared_ptr<User> old;
+                    if (_index) {
+                        typedef odb::query<User> query;
+                        old.reset(db->query_one<User>(query(query::user_id == uid) + "FOR UPDATE"));
+                        if (!old) {
+                            LOG_ERROR("更新用户失败，未找到用户 {}！", uid);
+                            return false;
+                        }
+                        for (const Index *index : {&NICKNAME_INDEX, &PHONE_INDEX}) {
+                            std::string key = index_key(*index, *user);
+                            if (key == index_key(*index, *old)) continue;
+                            if (index_add(*index, key, uid) != UpdateResult::OK) {
+                                for (auto &item : added) index_del(*item.first, item.second, uid);
+                                return false;
+                            }
+                            added.emplace_back(index, key);
+                        }
+                    }
+                    db->update(*user); // 更新用户对象数据
+                    trans.commit();
+                    for (auto &item : added) index_del(*item.first, index_key(*item.first, *old), uid);
+                } catch (std::exception &e) {
+                    LOG_ERROR("更新用户失败 {}:{}！", user->nickname(), e.what());
+                    for (auto &item : added) index_del(*item.first, item.second, uid);
+                    return false;
+                }
+                return true;
+            });
+            if (!ret) return false;
+            pin(user);
+            if (_on_change) _on_change(uid);
             return true;
         }
 
+        // 单字段更新：按用户ID直接执行一条 UPDATE，只写入一列，不需要先查询整行
+        // 自动提交模式下执行，一次往返完成；是否找到用户由匹配行数判断
+        // 分片部署下昵称、手机号还需要维护全局索引，额外读取旧值并读写索引表
+        UpdateResult update_nickname(const std::string &uid, const std::string &nickname) {
+            return update_column(uid, "nickname", nickname, &NICKNAME_INDEX);
+        }
+        UpdateResult update_description(const std::string &uid, const std::string &description) {
+            return update_column(uid, "description", description, nullptr);
+        }
+        UpdateResult update_avatar(const std::string &uid, const std::string &avatar_id) {
+            return update_column(uid, "avatar_id", avatar_id, nullptr);
+        }
+        UpdateResult update_phone(const std::string &uid, const std::string &phone) {
+            return update_column(uid, "phone", phone, &PHONE_INDEX);
+        }
+
         // 根据昵称查询用户记录
         // 参数：nickname - 用户的昵称
         // 返回值：若查询成功，返回查询到的用户对象；否则返回空指针
-        std::shared_ptr<User> select_by_nickname(const std::string &nickname) 
+        std::shared_ptr<User> select_by_nickname(const std::string &nickname)
         {
-            std::shared_ptr<User> res;
-            try {
-                odb::transaction trans(_db->begin());
+            return run([&]() {
+                if (_index) return select_by_index(NICKNAME_INDEX, nickname);
+                std::shared_ptr<User> res;
+                try {
+                    auto &db = _shards[0]->reader(nickname);
+                    odb::transaction trans(db->begin());
 
-                // 定义查询类型别名，便于构造查询条件
-                typedef odb::query<User> query;
-                typedef odb::result<User> result;
-                // 利用 ODB 提供的 query_one 方法查询符合条件的用户记录
-                res.reset(_db->query_one<User>(query::nickname == nickname));
+                    // 定义查询类型别名，便于构造查询条件
+                    typedef odb::query<User> query;
+                    typedef odb::result<User> result;
+                    // 利用 ODB 提供的 query_one 方法查询符合条件的用户记录
+                    res.reset(db->query_one<User>(query::nickname == nickname));
 
-                trans.commit();
-            } catch (std::exception &e) {
-                LOG_ERROR("通过昵称查询用户失败 {}:{}！", nickname, e.what());
-            }
-            return res;
+                    trans.commit();
+                } catch (std::exception &e) {
+                    LOG_ERROR("通过昵称查询用户失败 {}:{}！", nickname, e.what());
+                }
+                return res;
+            });
         }
 
         // 根据手机号查询用户记录
         // 参数：phone - 用户的手机号
         // 返回值：查询到的用户对象指针，如果查询失败则返回空指针
-        std::shared_ptr<User> select_by_phone(const std::string &phone) 
+        std::shared_ptr<User> select_by_phone(const std::string &phone)
         {
-            std::shared_ptr<User> res;
-            try {
-                odb::transaction trans(_db->begin());
-                typedef odb::query<User> query;
-                typedef odb::result<User> result;
-                res.reset(_db->query_one<User>(query::phone == phone));
-                trans.commit();
-            } catch (std::exception &e) {
-                LOG_ERROR("通过手机号查询用户失败 {}:{}！", phone, e.what());
-            }
-            return res;
+            return run([&]() {
+                if (_index) return select_by_index(PHONE_INDEX, phone);
+                std::shared_ptr<User> res;
+                try {
+                    auto &db = _shards[0]->reader(phone);
+                    odb::transaction trans(db->begin());
+                    typedef odb::query<User> query;
+                    typedef odb::result<User> result;
+                    res.reset(db->query_one<User>(query::phone == phone));
+                    trans.commit();
+                } catch (std::exception &e) {
+                    LOG_ERROR("通过手机号查询用户失败 {}:{}！", phone, e.what());
+                }
+                return res;
+            });
         }
 
         // 根据用户ID查询用户记录
         // 参数：user_id - 用户的唯一标识ID
         // 返回值：若查询成功，返回对应的用户对象；否则返回空指针
-        std::shared_ptr<User> select_by_id(const std::string &user_id) 
+        std::shared_ptr<User> select_by_id(const std::string &user_id)
         {
-            std::shared_ptr<User> res;
-            try {
-                odb::transaction trans(_db->begin());
-                typedef odb::query<User> query;
-                typedef odb::result<User> result;
-                res.reset(_db->query_one<User>(query::user_id == user_id));
-                trans.commit();
-            } catch (std::exception &e) {
-                LOG_ERROR("通过用户ID查询用户失败 {}:{}！", user_id, e.what());
-            }
-            return res;
+            return run([&]() {
+                return load_user(cluster(user_id)->reader(user_id), user_id);
+            });
+        }
+
+        // 根据用户ID从主库查询用户记录，用于回填缓存
+        // 与 select_by_id 不同：不读从库（从库延迟会把旧数据写回缓存），并区分用户不存在与查询失败
+        // 返回值：查询失败（包括执行器拒绝任务）返回 false；用户不存在时返回 true 且 user 为空
+        bool find_by_id(const std::string &user_id, std::shared_ptr<User> &user)
+        {
+            user.reset();
+            return run([&]() {
+                return load_user(cluster(user_id)->primary(), user_id, user);
+            });
         }
 
         // 根据多个用户ID查询用户记录
         // 参数：id_list - 用户ID列表，返回所有匹配的用户记录
         // 返回值：用户对象的 vector，如果列表为空或查询失败，返回空 vector
-        std::vector<User> select_multi_users(const std::vector<std::string> &id_list) 
+        // 用户ID以参数绑定的方式传入预编译查询，不拼接 SQL 文本：
+        //   IN 列表只有 1/8/32/128 四种长度，每种长度的预编译语句在每个连接上只准备一次，之后只绑定参数执行
+        //   较长的列表按 128 分块，剩余部分使用能容纳它的最小长度，空位用最后一个ID填充
+        // 多个分片时按分片分组，配置了执行器时各分片的查询同时提交到执行器并行执行
+        std::vector<User> select_multi_users(const std::vector<std::string> &id_list)
         {
             // 如果传入的 id_list 为空，直接返回空 vector
             if (id_list.empty()) {
                 return std::vector<User>();
             }
+            // 去除重复的ID，避免同一用户出现在不同分块中而被重复返回
+            std::vector<std::vector<std::string>> groups(_shards.size());
+            std::unordered_set<std::string> seen;
+            for (const auto &id : id_list) {
+                if (seen.insert(id).second) groups[shard_of(id, _shards.size())].push_back(id);
+            }
+            if (_shards.size() == 1) {
+                return run([&]() { return select_ids(_shards[0], groups[0]); });
+            }
+
             std::vector<User> res;
+            if (!_executor) {
+                for (size_t i = 0; i < groups.size(); ++i) {
+                    if (groups[i].empty()) continue;
+                    std::vector<User> part = select_ids(_shards[i], groups[i]);
+                    res.insert(res.end(), std::make_move_iterator(part.begin()), std::make_move_iterator(part.end()));
+                }
+                return res;
+            }
+            // 先全部提交再逐个等待：各分片的查询同时进行，耗时取决于最慢的分片
+            std::vector<ExecFuture<std::vector<User>>> futures;
+            for (size_t i = 0; i < groups.size(); ++i) {
+                if (groups[i].empty()) continue;
+                futures.push_back(_executor->submit([this, &groups, i]() {
+                    return select_ids(_shards[i], groups[i]);
+                }));
+            }
+            for (auto &future : futures) {
+                try {
+                    std::vector<User> part = future.get();
+                    res.insert(res.end(), std::make_move_iterator(part.begin()), std::make_move_iterator(part.end()));
+                } catch (std::exception &e) {
+                    LOG_ERROR("提交分片批量查询失败:{}！", e.what());
+                }
+            }
+            return res;
+        }
+
+    private:
+        // 执行一次数据库操作：配置了执行器时交给执行器线程执行，调用方（bthread）挂起等待结果
+        // 执行器拒绝任务（队列已满）时按操作失败处理，返回 failed；不指定时返回空结果（false、空指针、空列表）
+        template <typename F>
+        auto run(F &&f) -> decltype(f()) {
+            return run(std::forward<F>(f), decltype(f())());
+        }
+        template <typename F, typename R>
+        R run(F &&f, R failed) {
+            if (!_executor) return f();
             try {
-                odb::transaction trans(_db->begin());
+                return _executor->run(std::forward<F>(f));
+            } catch (std::exception &e) {
+                LOG_ERROR("提交数据库操作失败:{}！", e.what());
+                return failed;
+            }
+        }
+
+        // 用户ID所在分片
+        const ODBCluster::ptr &cluster(const std::string &uid) {
+            return _shards[shard_of(uid, _shards.size())];
+        }
+
+        // 昵称、手机号所在的库：分片部署下为索引库，否则为唯一的分片
+        const ODBCluster::ptr &key_cluster(const std::string &uid) {
+            return _index ? _index : cluster(uid);
+        }
+
+        // 写入后按用户ID、昵称、手机号固定走主库
+        void pin(const std::shared_ptr<User> &user) {
+            std::string uid = user->user_id();
+            cluster(uid)->pin(uid);
+            if (!user->nickname().empty()) key_cluster(uid)->pin(user->nickname());
+            if (!user->phone().empty()) key_cluster(uid)->pin(user->phone());
+        }
+
+        // 事务所在连接的 MYSQL 句柄，用于在事务中直接执行语句
+        static MYSQL *handle_of(odb::transaction &trans) {
+            return static_cast<odb::mysql::connection &>(trans.connection()).handle();
+        }
+
+        // 取得数据库的一个连接，通过 MySQL C API 直接执行语句
+        static odb::mysql::connection_ptr connect(const ODBCluster::DB &db) {
+            return static_cast<odb::mysql::database &>(*db).connection();
+        }
+
+        // 在 db 上按用户ID查询用户记录
+        static std::shared_ptr<User> load_user(const ODBCluster::DB &db, const std::string &user_id) {
+            std::shared_ptr<User> res;
+            load_user(db, user_id, res);
+            return res;
+        }
+        // 查询失败时返回 false，用户不存在时返回 true 且 res 为空
+        static bool load_user(const ODBCluster::DB &db, const std::string &user_id, std::shared_ptr<User> &res) {
+            try {
+                odb::transaction trans(db->begin());
                 typedef odb::query<User> query;
-                typedef odb::result<User> result;
+                res.reset(db->query_one<User>(query::user_id == user_id));
+                trans.commit();
+            } catch (std::exception &e) {
+                LOG_ERROR("通过用户ID查询用户失败 {}:{}！", user_id, e.what());
+                res.reset();
+                return false;
+            }
+            return true;
+        }
 
-                // 构造 SQL 中 IN 条件的字符串：例如 "user_id in ('id1','id2',...)"
-                std::stringstream ss;
-                ss << "user_id in (";
-                for (const auto &id : id_list) {
-                    ss << "'" << id << "',";
+        // 查询一个分片中的多个用户ID
+        static std::vector<User> select_ids(const ODBCluster::ptr &cluster, const std::vector<std::string> &ids) {
+            std::vector<User> res;
+            try {
+                odb::transaction trans(cluster->reader(ids)->begin());
+                odb::connection &conn(trans.connection());
+                size_t pos = 0;
+                while (pos < ids.size()) {
+                    size_t n = std::min<size_t>(ids.size() - pos, 128);
+                    if (n > 32) select_chunk<128>(conn, "user_select_multi_128", &ids[pos], n, res);
+                    else if (n > 8) select_chunk<32>(conn, "user_select_multi_32", &ids[pos], n, res);
+                    else if (n > 1) select_chunk<8>(conn, "user_select_multi_8", &ids[pos], n, res);
+                    else select_chunk<1>(conn, "user_select_multi_1", &ids[pos], n, res);
+                    pos += n;
                 }
+                trans.commit();
+            } catch (std::exception &e) {
+                LOG_ERROR("通过用户ID批量查询用户失败:{}！", e.what());
+            }
+            return res;
+        }
 
-                // 移除最后多余的逗号，并添加右括号
-                std::string condition = ss.str();
-                condition.pop_back();
-                condition += ")";
-
-                // 利用自定义条件进行查询
-                result r(_db->query<User>(condition));
-                // 遍历查询结果，存入返回 vector 中
-                for (result::iterator i(r.begin()); i != r.end(); ++i) {
-                    res.push_back(*i);
+        // 执行 UPDATE `user` SET `column` = ? WHERE `user_id` = ?
+        // 以预编译语句执行，参数绑定传入；column 只能是本类传入的字段名常量
+        // index 非空时该字段是昵称或手机号，更新后新值也固定走主库，分片部署下同时维护全局索引
+        UpdateResult update_column(const std::string &uid, const char *column,
+                                   const std::string &value, const Index *index)
+        {
+            UpdateResult ret = run([&]() {
+                if (!index || !_index) {
+                    try {
+                        odb::mysql::connection_ptr conn(connect(cluster(uid)->primary()));
+                        return execute_update(conn->handle(), uid, column, value);
+                    } catch (std::exception &e) {
+                        LOG_ERROR("更新用户 {} 的 {} 失败:{}！", uid, column, e.what());
+                        return UpdateResult::FAILED;
+                    }
                 }
+                return update_indexed_column(uid, column, value, *index);
+            }, UpdateResult::FAILED); // 值初始化的 UpdateResult 是 OK，提交失败时必须显式返回 FAILED
+            if (ret != UpdateResult::OK) return ret;
+            cluster(uid)->pin(uid);
+            if (index && !value.empty()) key_cluster(uid)->pin(value);
+            if (_on_change) _on_change(uid);
+            return ret;
+        }
 
+        // 分片部署下更新昵称或手机号：锁定用户行读取旧值，登记新值后更新并提交，最后删除旧值
+        // 行锁使同一用户的并发修改串行执行，后执行的修改读到的旧值就是先执行的修改写入的新值
+        UpdateResult update_indexed_column(const std::string &uid, const char *column,
+                                           const std::string &value, const Index &index)
+        {
+            bool added = false;
+            try {
+                odb::transaction trans(cluster(uid)->primary()->begin());
+                MYSQL *handle = handle_of(trans);
+                std::string old;
+                bool found = false;
+                PreparedStmt select(handle, std::string("SELECT `") + column + "` FROM `user` WHERE `user_id` = ? FOR UPDATE");
+                if (!select.query_value({uid}, old, found)) {
+                    LOG_ERROR("锁定用户 {} 读取 {} 失败:{}！", uid, column, select.error());
+                    return UpdateResult::FAILED;
+                }
+                if (!found) return UpdateResult::NOT_FOUND;
+                if (old == value) return UpdateResult::OK;
+                UpdateResult res = index_add(index, value, uid);
+                if (res != UpdateResult::OK) return res;
+                added = true;
+                res = execute_update(handle, uid, column, value);
+                if (res != UpdateResult::OK) {
+                    index_del(index, value, uid);
+                    return res;
+                }
                 trans.commit();
+                index_del(index, old, uid);
+                return UpdateResult::OK;
             } catch (std::exception &e) {
-                LOG_ERROR("通过用户ID批量查询用户失败:{}！", e.what());
+                LOG_ERROR("更新用户 {} 的 {} 失败:{}！", uid, column, e.what());
+                if (added) index_del(index, value, uid);
+            }
+            return UpdateResult::FAILED;
+        }
+
+        // 在 handle 所在连接上执行单字段 UPDATE
+        static UpdateResult execute_update(MYSQL *handle, const std::string &uid,
+                                           const char *column, const std::string &value) {
+            PreparedStmt update(handle, std::string("UPDATE `user` SET `") + column + "` = ? WHERE `user_id` = ?");
+            if (!update.execute({value, uid})) {
+                if (update.error_code() == ER_DUP_ENTRY_CODE) {
+                    LOG_WARN("更新用户 {} 的 {} 失败，与其他用户重复：{}", uid, column, value);
+                    return UpdateResult::CONFLICT;
+                }
+                LOG_ERROR("更新用户 {} 的 {} 失败:{}！", uid, column, update.error());
+                return UpdateResult::FAILED;
+            }
+            if (update.affected_rows() > 0) return UpdateResult::OK;
+            // 新值与旧值相同时受影响行数为 0，需要从 "Rows matched: N ..." 中取匹配行数
+            const char *info = mysql_info(handle);
+            unsigned long matched = 0;
+            if (info && sscanf(info, "Rows matched: %lu", &matched) == 1) {
+                return matched > 0 ? UpdateResult::OK : UpdateResult::NOT_FOUND;
+            }
+            // 客户端库没有提供匹配信息时，再查询一次用户是否存在
+            PreparedStmt select(handle, "SELECT 1 FROM `user` WHERE `user_id` = ?");
+            std::string one;
+            bool found = false;
+            if (!select.query_value({uid}, one, found)) {
+                LOG_ERROR("查询用户 {} 是否存在失败:{}！", uid, select.error());
+                return UpdateResult::FAILED;
             }
+            return found ? UpdateResult::OK : UpdateResult::NOT_FOUND;
+        }
+
+        // 通过全局索引查询用户：先从索引库取得用户ID，再到所在分片查询用户记录
+        std::shared_ptr<User> select_by_index(const Index &index, const std::string &key) {
+            std::string uid;
+            try {
+                odb::mysql::connection_ptr conn(connect(_index->reader(key)));
+                if (!index_get(conn->handle(), index, key, uid)) return nullptr;
+            } catch (std::exception &e) {
+                LOG_ERROR("查询全局索引 {} 失败 {}:{}！", index.table, key, e.what());
+                return nullptr;
+            }
+            if (uid.empty()) return nullptr;
+            std::shared_ptr<User> res = load_user(cluster(uid)->reader(uid), uid);
+            // 索引行可能是写入中途失败留下的，以用户表中的值为准
+            if (res && index_key(index, *res) != key) return nullptr;
             return res;
         }
 
+        // 在全局索引中登记 key -> uid，key 为空时不登记
+        // key 已属于同一用户时（例如上次写入中途失败）视为成功；
+        // 属于其他用户时检查该用户当前是否仍在使用 key，已不再使用时接管，否则返回 CONFLICT
+        UpdateResult index_add(const Index &index, const std::string &key, const std::string &uid) {
+            if (key.empty()) return UpdateResult::OK;
+            try {
+                odb::mysql::connection_ptr conn(connect(_index->primary()));
+                MYSQL *handle = conn->handle();
+                // 索引行可能在插入失败与读取占用者之间被删除或接管，重试一次
+                for (int attempt = 0; attempt < 2; ++attempt) {
+                    PreparedStmt insert(handle, std::string("INSERT INTO `") + index.table + "` (`" + index.column +
+                        "`, `user_id`) VALUES (?, ?)");
+                    if (insert.execute({key, uid})) return UpdateResult::OK;
+                    if (insert.error_code() != ER_DUP_ENTRY_CODE) {
+                        LOG_ERROR("登记全局索引 {} 失败 {}:{}！", index.table, key, insert.error());
+                        return UpdateResult::FAILED;
+                    }
+                    std::string owner;
+                    if (!index_get(handle, index, key, owner)) return UpdateResult::FAILED;
+                    if (owner.empty()) continue;
+                    if (owner == uid) return UpdateResult::OK;
+                    UpdateResult res = take_over(handle, index, key, owner, uid);
+                    if (res != UpdateResult::NOT_FOUND) return res;
+                }
+                LOG_WARN("登记全局索引 {} 时索引行反复变化：{}", index.table, key);
+                return UpdateResult::CONFLICT;
+            } catch (std::exception &e) {
+                LOG_ERROR("登记全局索引 {} 失败 {}:{}！", index.table, key, e.what());
+            }
+            return UpdateResult::FAILED;
+        }
+
+        // 接管 owner 已不再使用的索引行，handle 为索引库连接
+        // 锁定 owner 的用户行后检查其当前值：仍为 key 或该行正被其他事务锁定（owner 正在写入）时返回 CONFLICT；
+        // 持有行锁期间改写索引行，owner 不会同时重新登记该 key；索引行已被他人改写时返回 NOT_FOUND 由调用方重试
+        // MySQL 8.0 起使用 FOR UPDATE NOWAIT 不等待行锁，旧版本不支持时退回 FOR UPDATE（等待至 innodb_lock_wait_timeout）
+        UpdateResult take_over(MYSQL *handle, const Index &index, const std::string &key,
+                               const std::string &owner, const std::string &uid) {
+            // 调用方可能正处于自己的事务中，这里的事务不设为当前事务
+            odb::transaction trans(cluster(owner)->primary()->begin(), false);
+            MYSQL *owner_handle = handle_of(trans);
+            std::string sql = std::string("SELECT `") + index.column + "` FROM `user` WHERE `user_id` = ? FOR UPDATE";
+            std::string current;
+            bool found = false;
+            PreparedStmt nowait(owner_handle, sql + " NOWAIT");
+            bool ok = nowait.query_value({owner}, current, found);
+            unsigned int err = nowait.error_code();
+            std::string error = nowait.error();
+            if (!ok && err == ER_PARSE_ERROR_CODE) {
+                PreparedStmt wait(owner_handle, sql);
+                ok = wait.query_value({owner}, current, found);
+                err = wait.error_code();
+                error = wait.error();
+            }
+            if (!ok) {
+                if (err == ER_LOCK_NOWAIT_CODE || err == ER_LOCK_WAIT_TIMEOUT_CODE || err == ER_LOCK_DEADLOCK_CODE) {
+                    LOG_WARN("{} 的占用者 {} 正在写入：{}", index.column, owner, key);
+                    return UpdateResult::CONFLICT;
+                }
+                LOG_ERROR("查询 {} 的占用者 {} 失败:{}！", index.column, owner, error);
+                return UpdateResult::FAILED;
+            }
+            if (found && current == key) {
+                LOG_WARN("{} 已被用户 {} 占用：{}", index.column, owner, key);
+                return UpdateResult::CONFLICT;
+            }
+            PreparedStmt update(handle, std::string("UPDATE `") + index.table + "` SET `user_id` = ? WHERE `" +
+                index.column + "` = ? AND `user_id` = ?");
+            if (!update.execute({uid, key, owner})) {
+                LOG_ERROR("接管全局索引 {} 失败 {}:{}！", index.table, key, update.error());
+                return UpdateResult::FAILED;
+            }
+            if (update.affected_rows() == 0) return UpdateResult::NOT_FOUND;
+            trans.commit();
+            LOG_INFO("接管用户 {} 已不再使用的 {}：{}", owner, index.column, key);
+            return UpdateResult::OK;
+        }
+
+        // 删除全局索引中属于 uid 的 key，失败时只记录日志：多余的索引行在其他用户登记该 key 时被接管
+        void index_del(const Index &index, const std::string &key, const std::string &uid) {
+            if (key.empty()) return;
+            try {
+                odb::mysql::connection_ptr conn(connect(_index->primary()));
+                MYSQL *handle = conn->handle();
+                PreparedStmt del(handle, std::string("DELETE FROM `") + index.table + "` WHERE `" + index.column +
+                    "` = ? AND `user_id` = ?");
+                if (!del.execute({key, uid})) {
+                    LOG_ERROR("删除全局索引 {} 失败 {}:{}！", index.table, key, del.error());
+                }
+            } catch (std::exception &e) {
+                LOG_ERROR("删除全局索引 {} 失败 {}:{}！", index.table, key, e.what());
+            }
+        }
+
+        // 查询全局索引中 key 对应的用户ID，不存在时 uid 为空
+        static bool index_get(MYSQL *handle, const Index &index, const std::string &key, std::string &uid) {
+            PreparedStmt select(handle, std::string("SELECT `user_id` FROM `") + index.table + "` WHERE `" +
+                index.column + "` = ?");
+            bool found = false;
+            if (!select.query_value({key}, uid, found)) {
+                LOG_ERROR("查询全局索引 {} 失败 {}:{}！", index.table, key, select.error());
+                return false;
+            }
+            return true;
+        }
+
+        // 用户对象中与索引对应的字段值
+        static std::string index_key(const Index &index, User &user) {
+            return &index == &PHONE_INDEX ? user.phone() : user.nickname();
+        }
+
+        // N 个用户ID的查询参数，预编译查询通过引用绑定其中的字符串
+        template <size_t N>
+        struct IdParams
+        {
+            std::string ids[N];
+        };
+
+        // 使用长度为 N 的预编译 IN 查询查询 ids 中的 n 个用户ID（n <= N）
+        // name 为预编译查询在连接上的缓存名称，需要是字符串常量
+        template <size_t N>
+        static void select_chunk(odb::connection &conn, const char *name,
+                                 const std::string *ids, size_t n, std::vector<User> &res)
+        {
+            typedef odb::query<User> query;
+            typedef odb::prepared_query<User> prep_query;
+            typedef odb::result<User> result;
+
+            IdParams<N> *params = nullptr;
+            prep_query pq(conn.lookup_query<User>(name, params));
+            if (!pq) {
+                // 生成 "user_id IN (?,?,...)"，每个占位符引用 params 中的一个字符串
+                std::unique_ptr<IdParams<N>> up(new IdParams<N>);
+                params = up.get();
+                query q("user_id IN (");
+                for (size_t i = 0; i < N; ++i) {
+                    if (i > 0) q += ",";
+                    q += query::_ref(params->ids[i]);
+                }
+                q += ")";
+                pq = conn.prepare_query<User>(name, q);
+                conn.cache_query(pq, std::move(up));
+            }
+            for (size_t i = 0; i < N; ++i) params->ids[i] = ids[std::min(i, n - 1)];
+            result r(pq.execute());
+            for (result::iterator i(r.begin()); i != r.end(); ++i) {
+                res.push_back(*i);
+            }
+        }
     private:
-        // 数据库对象指针，所有数据库操作均通过此对象执行
-        std::shared_ptr<odb::core::database> _db;
+        static const unsigned int ER_DUP_ENTRY_CODE = 1062;          // MySQL 唯一索引冲突错误码
+        static const unsigned int ER_PARSE_ERROR_CODE = 1064;        // SQL 语法错误（旧版本不支持 NOWAIT）
+        static const unsigned int ER_LOCK_WAIT_TIMEOUT_CODE = 1205;  // 等待行锁超时
+        static const unsigned int ER_LOCK_DEADLOCK_CODE = 1213;      // 等待行锁时检测到死锁
+        static const unsigned int ER_LOCK_NOWAIT_CODE = 3572;        // NOWAIT 时行已被锁定
+
+        // 用户表分片，每个分片为一个主库与只读从库组成的集群，所有数据库操作均通过这些对象执行
+        std::vector<ODBCluster::ptr> _shards;
+        ODBCluster::ptr _index;     // 全局索引表所在的库，只有一个分片时为空
+        Executor::ptr _executor;    // 阻塞 I/O 执行器，为空时在调用线程中直接执行
+        ChangeCallback _on_change;  // 用户记录变更回调
     };
 
-} 
+}
@@ -0,0 +1,527 @@
+#pragma once
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <bvar/bvar.h>
+#include <cstring>
+#include <deque>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "rabbitmq.hpp"
+#include "logger.hpp"
+
+namespace liren {
+    // MQOutbox 的可选参数
+    struct OutboxOptions
+    {
+        std::string path = "./mq_outbox.log";  // 本地日志路径前缀，日志分段保存为 path + ".<段内首条序号>"，已投递位置保存在 path + ".offset"
+        int flush_interval_ms = 10;             // 批量写盘并 fsync 的间隔，进程崩溃最多丢失这段时间内提交的消息
+        size_t max_in_flight = 256;             // 已发出但尚未完成的消息数上限
+        size_t max_rate = 5000;                 // 每秒最多投递的消息数，避免恢复连接后积压消息瞬间压垮服务器，0 表示不限制
+        int retry_interval_ms = 1000;           // 投递失败后重试的间隔
+        size_t max_bytes = 1ull << 30;          // 积压消息的总大小上限，超过后拒绝新消息
+        size_t segment_bytes = 64ull << 20;     // 单个日志段的大小，超过后切换到新段；段内消息全部投递后删除该段
+        int shutdown_timeout_ms = 5000;         // 析构时等待已发出消息完成的时间，超时后不再处理这些消息的回调
+        std::string metrics_prefix = "mq_outbox";
+    };
+
+    // 消息发件箱：消息先追加到本地日志，再由后台线程按提交顺序投递到 RabbitMQ
+    // 服务器不可用时消息在本地持续积压，发布方不受影响；恢复后按顺序、按限速补发
+    // 投递语义为至少一次：失败重试时从第一条未确认的消息开始重发，可能产生重复消息
+    // 日志按大小分段，已投递位置越过整段后删除该段，积压持续存在时日志也不会无限增长
+    class MQOutbox
+    {
+    public:
+        using ptr = std::shared_ptr<MQOutbox>;
+        using PublishFunc = std::function<void(const std::string &, const std::string &, const std::string &,
+                                               const MessageQueue::PublishCallback &)>;
+
+        // client 可以是 MQClient、ShardedMQClient 或 LocalMQ，建议开启发布确认，否则消息写入连接即视为投递成功
+        MQOutbox(const MessageQueue::ptr &client, const OutboxOptions &options = OutboxOptions())
+            : MQOutbox(PublishFunc([client](const std::string &exchange, const std::string &msg,
+                                            const std::string &routing_key, const MessageQueue::PublishCallback &cb) {
+                  client->publish_async(exchange, msg, routing_key, cb);
+              }), options)
+        {}
+
+        MQOutbox(const PublishFunc &publish, const OutboxOptions &options = OutboxOptions())
+            : _publish(publish)
+            , _options(options)
+            , _depth(get_depth, this)
+            , _age(get_age, this)
+            , _spool_bytes(get_bytes, this)
+            , _link(std::make_shared<Link>())
+        {
+            _link->outbox = this;
+            recover();
+            _depth.expose_as(_options.metrics_prefix, "depth");
+            _age.expose_as(_options.metrics_prefix, "age_ms");
+            _spool_bytes.expose_as(_options.metrics_prefix, "bytes");
+            _delivered.expose_as(_options.metrics_prefix, "delivered");
+            _retries.expose_as(_options.metrics_prefix, "retries");
+            _rejected.expose_as(_options.metrics_prefix, "rejected");
+            _write_errors.expose_as(_options.metrics_prefix, "write_errors");
+            _flush_thread = std::thread([this]() { flush_loop(); });
+            _drain_thread = std::thread([this]() { drain_loop(); });
+        }
+
+        ~MQOutbox() {
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                _running = false;
+            }
+            _cond.notify_all();
+            _flush_cond.notify_all();
+            _drain_thread.join();
+            _flush_thread.join();
+            // 等待已发出消息的完成回调；超时后断开回调与本对象的关联，之后到达的回调直接丢弃，
+            // 这些消息未计入已投递位置，重启后会重新投递
+            std::unique_lock<std::mutex> lock(_mtx);
+            if (!_cond.wait_for(lock, std::chrono::milliseconds(_options.shutdown_timeout_ms),
+                                [this]() { return _in_flight == 0; })) {
+                LOG_WARN("发件箱关闭时仍有 {} 条消息未完成，重启后重新投递", _in_flight);
+            }
+            lock.unlock();
+            {
+                std::unique_lock<std::mutex> link_lock(_link->mtx);
+                _link->outbox = nullptr;
+            }
+            flush();
+            if (_fd >= 0) close(_fd);
+        }
+
+        // 提交一条消息：只追加到内存缓冲区，由后台线程批量写盘后返回，不等待服务器
+        // 积压超过上限时返回 false
+        bool publish(const std::string &exchange,
+                     const std::string &msg,
+                     const std::string &routing_key = "routing_key")
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            if (_bytes + msg.size() > _options.max_bytes) {
+                _rejected << 1;
+                LOG_ERROR("发件箱积压已达上限，拒绝消息：{}-{}", exchange, routing_key);
+                return false;
+            }
+            Entry entry;
+            entry.seq = ++_seq;
+            entry.ts_ms = now_ms();
+            entry.exchange = exchange;
+            entry.routing_key = routing_key;
+            entry.msg = msg;
+            encode(entry, _buffer);
+            _bytes += entry.msg.size();
+            _pending.push_back(std::move(entry));
+            lock.unlock();
+            _cond.notify_all();
+            return true;
+        }
+    private:
+        // 完成回调通过 Link 访问本对象：回调持有 Link 的引用，析构后 outbox 置空
+        // 回调执行期间持有 mtx，析构置空时会等待正在执行的回调结束
+        struct Link
+        {
+            std::mutex mtx;
+            MQOutbox *outbox = nullptr;
+        };
+
+        // 日志段：文件名中的序号为段内第一条记录的序号，后一段的首条序号减一即为本段最后一条记录的序号
+        struct Segment
+        {
+            uint64_t first = 0;
+            std::string name;
+            size_t size = 0;
+        };
+
+        struct Entry
+        {
+            uint64_t seq = 0;
+            int64_t ts_ms = 0;        // 提交时间，用于统计积压时长
+            std::string exchange;
+            std::string routing_key;
+            std::string msg;
+            bool sent = false;        // 是否已发出（等待完成）
+            bool acked = false;       // 是否已投递成功
+        };
+
+        static int64_t now_ms() {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+        static uint32_t checksum(const char *data, size_t len) {
+            uint32_t h = 2166136261u;
+            for (size_t i = 0; i < len; ++i) h = (h ^ static_cast<unsigned char>(data[i])) * 16777619u;
+            return h;
+        }
+
+        template <typename T>
+        static void put(std::string &out, T val) {
+            out.append(reinterpret_cast<const char *>(&val), sizeof(T));
+        }
+        template <typename T>
+        static bool get(const char *&p, const char *end, T &val) {
+            if (end - p < static_cast<ptrdiff_t>(sizeof(T))) return false;
+            memcpy(&val, p, sizeof(T));
+            p += sizeof(T);
+            return true;
+        }
+
+        // 日志记录格式：[长度 u32][校验和 u32][序号 u64][时间 i64][交换机长度 u16][交换机][路由键长度 u16][路由键][消息]
+        // 长度与校验和覆盖序号之后的全部内容
+        static void encode(const Entry &entry, std::string &out) {
+            std::string body;
+            put<uint64_t>(body, entry.seq);
+            put<int64_t>(body, entry.ts_ms);
+            put<uint16_t>(body, entry.exchange.size());
+            body.append(entry.exchange);
+            put<uint16_t>(body, entry.routing_key.size());
+            body.append(entry.routing_key);
+            body.append(entry.msg);
+            put<uint32_t>(out, body.size());
+            put<uint32_t>(out, checksum(body.data(), body.size()));
+            out.append(body);
+        }
+
+        static bool decode(const char *p, const char *end, Entry &entry) {
+            uint16_t len = 0;
+            if (!get(p, end, entry.seq) || !get(p, end, entry.ts_ms) || !get(p, end, len)) return false;
+            if (end - p < len) return false;
+            entry.exchange.assign(p, len);
+            p += len;
+            if (!get(p, end, len) || end - p < len) return false;
+            entry.routing_key.assign(p, len);
+            p += len;
+            entry.msg.assign(p, end - p);
+            return true;
+        }
+
+        std::string segment_name(uint64_t first) const {
+            return _options.path + "." + std::to_string(first);
+        }
+
+        // 列出已有的日志段并按首条序号排序；旧版本的单文件日志（path 本身）视为首条序号为 0 的段
+        std::deque<Segment> list_segments() const {
+            std::deque<Segment> segments;
+            std::string dir = ".", base = _options.path;
+            size_t slash = _options.path.rfind('/');
+            if (slash != std::string::npos) {
+                dir = slash == 0 ? "/" : _options.path.substr(0, slash);
+                base = _options.path.substr(slash + 1);
+            }
+            DIR *dp = opendir(dir.c_str());
+            if (!dp) return segments;
+            while (struct dirent *ent = readdir(dp)) {
+                std::string name = ent->d_name;
+                Segment segment;
+                if (name == base) {
+                    segment.name = _options.path;
+                } else if (name.size() > base.size() + 1 && name.compare(0, base.size() + 1, base + ".") == 0 &&
+                           std::all_of(name.begin() + base.size() + 1, name.end(), ::isdigit)) {
+                    segment.first = std::stoull(name.substr(base.size() + 1));
+                    segment.name = segment_name(segment.first);
+                } else {
+                    continue;
+                }
+                segments.push_back(std::move(segment));
+            }
+            closedir(dp);
+            std::sort(segments.begin(), segments.end(),
+                      [](const Segment &a, const Segment &b) { return a.first < b.first; });
+            return segments;
+        }
+
+        // 删除记录全部已投递的日志段，最后一段（当前写入的段）总是保留
+        void drop_segments(uint64_t committed) {
+            while (_segments.size() > 1 && _segments[1].first <= committed + 1) {
+                if (unlink(_segments.front().name.c_str()) != 0 && errno != ENOENT)
+                    LOG_ERROR("删除发件箱日志段失败：{} - {}", _segments.front().name, strerror(errno));
+                _segments.pop_front();
+            }
+        }
+
+        // 切换到以 first 为首条序号的新日志段，失败时继续写入当前段
+        // 与最后一段同名时说明该段写入失败后被关闭，其中没有成功写入的记录，清空后重新使用
+        void rotate(uint64_t first) {
+            std::string name = segment_name(first);
+            bool reuse = !_segments.empty() && _segments.back().first == first;
+            int fd = open(name.c_str(), O_RDWR | O_CREAT | O_APPEND | (reuse ? O_TRUNC : 0), 0644);
+            if (fd < 0) {
+                LOG_ERROR("创建发件箱日志段失败：{} - {}", name, strerror(errno));
+                return;
+            }
+            if (_fd >= 0) close(_fd);
+            _fd = fd;
+            if (reuse) {
+                _segments.back().size = 0;
+                return;
+            }
+            Segment segment;
+            segment.first = first;
+            segment.name = name;
+            _segments.push_back(std::move(segment));
+        }
+
+        // 读取一个日志段，恢复其中尚未投递的消息；末尾不完整或校验失败的记录（写入时崩溃）被截掉
+        void read_segment(Segment &segment, uint64_t committed) {
+            int fd = open(segment.name.c_str(), O_RDWR);
+            if (fd < 0) {
+                LOG_ERROR("打开发件箱日志段失败：{} - {}", segment.name, strerror(errno));
+                return;
+            }
+            std::string data;
+            char buf[65536];
+            ssize_t n;
+            while ((n = pread(fd, buf, sizeof(buf), data.size())) > 0) data.append(buf, n);
+
+            size_t pos = 0;
+            while (data.size() - pos >= 8) {
+                uint32_t len, sum;
+                memcpy(&len, data.data() + pos, 4);
+                memcpy(&sum, data.data() + pos + 4, 4);
+                if (data.size() - pos - 8 < len) break;
+                const char *body = data.data() + pos + 8;
+                Entry entry;
+                if (checksum(body, len) != sum || !decode(body, body + len, entry)) break;
+                pos += 8 + len;
+                _seq = std::max(_seq, entry.seq);
+                // 写入失败时截断不成功，失败的那批记录可能已有一部分留在上一段中，之后又完整写入了新段，跳过重复的记录
+                if (entry.seq <= committed || (!_pending.empty() && entry.seq <= _pending.back().seq)) continue;
+                _bytes += entry.msg.size();
+                _pending.push_back(std::move(entry));
+            }
+            if (pos < data.size()) {
+                LOG_WARN("发件箱日志段 {} 末尾存在不完整记录，截断 {} 字节", segment.name, data.size() - pos);
+                if (ftruncate(fd, pos) != 0) LOG_ERROR("截断发件箱日志失败：{}", strerror(errno));
+            }
+            segment.size = pos;
+            close(fd);
+        }
+
+        // 启动时读取日志，恢复尚未投递的消息：记录全部已投递的段直接删除，其余段逐段读取
+        void recover() {
+            uint64_t committed = 0;
+            FILE *fp = fopen((_options.path + ".offset").c_str(), "r");
+            if (fp) {
+                unsigned long long val = 0;
+                if (fscanf(fp, "%llu", &val) == 1) committed = val;
+                fclose(fp);
+            }
+            _seq = _committed = _saved_committed = committed;
+
+            _segments = list_segments();
+            drop_segments(committed);
+            for (auto &segment : _segments) read_segment(segment, committed);
+            if (_segments.empty()) {
+                rotate(_seq + 1);
+            } else {
+                _fd = open(_segments.back().name.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+                if (_fd < 0) LOG_ERROR("打开发件箱日志失败：{} - {}", _segments.back().name, strerror(errno));
+            }
+            _flushed = _seq;
+            if (!_pending.empty()) LOG_INFO("发件箱恢复 {} 条未投递的消息", _pending.size());
+        }
+
+        // 后台写盘线程：按固定间隔把缓冲区一次写入日志并 fsync，同时保存已投递位置
+        void flush_loop() {
+            std::unique_lock<std::mutex> lock(_mtx);
+            while (_running) {
+                _flush_cond.wait_for(lock, std::chrono::milliseconds(_options.flush_interval_ms));
+                lock.unlock();
+                flush();
+                lock.lock();
+            }
+        }
+
+        // 把缓冲区写入当前日志段：日志段不可用时先重试创建，仍不可用则记录保留在缓冲区中，下次写盘时再试；
+        // 写入失败时截掉本批已写入的部分并关闭该段，本批记录放回缓冲区，之后写入以下一条序号开头的新段
+        void flush() {
+            if (_fd < 0) {
+                auto now = std::chrono::steady_clock::now();
+                if (now >= _next_open) {
+                    _next_open = now + std::chrono::milliseconds(_options.retry_interval_ms);
+                    rotate(_flushed + 1);
+                }
+            }
+            std::string buffer;
+            uint64_t committed, written;
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                committed = _committed;
+                if (_fd < 0) {
+                    if (!_buffer.empty()) _write_errors << 1;
+                    return;
+                }
+                buffer.swap(_buffer);
+                written = _seq; // 缓冲区中最后一条记录的序号
+            }
+            if (!buffer.empty()) {
+                size_t off = 0;
+                bool ok = true;
+                while (off < buffer.size()) {
+                    ssize_t n = write(_fd, buffer.data() + off, buffer.size() - off);
+                    if (n < 0) {
+                        if (errno == EINTR) continue;
+                        LOG_ERROR("写入发件箱日志失败：{}", strerror(errno));
+                        ok = false;
+                        break;
+                    }
+                    off += n;
+                }
+                if (ok && fdatasync(_fd) != 0) {
+                    LOG_ERROR("同步发件箱日志失败：{}", strerror(errno));
+                    ok = false;
+                }
+                if (!ok) {
+                    _write_errors << 1;
+                    if (ftruncate(_fd, _segments.back().size) != 0)
+                        LOG_ERROR("截断发件箱日志失败：{}", strerror(errno));
+                    close(_fd);
+                    _fd = -1;
+                    std::unique_lock<std::mutex> lock(_mtx);
+                    _buffer.insert(0, buffer);
+                    return;
+                }
+                _segments.back().size += off;
+                _flushed = written;
+            }
+            if (committed != _saved_committed) {
+                // 先写临时文件再重命名，保证位置文件不会写坏
+                std::string tmp = _options.path + ".offset.tmp";
+                FILE *fp = fopen(tmp.c_str(), "w");
+                if (fp) {
+                    fprintf(fp, "%llu\n", static_cast<unsigned long long>(committed));
+                    fflush(fp);
+                    fsync(fileno(fp));
+                    fclose(fp);
+                    rename(tmp.c_str(), (_options.path + ".offset").c_str());
+                    _saved_committed = committed;
+                }
+            }
+            if (_segments.back().size >= _options.segment_bytes) rotate(_flushed + 1);
+            // 只按已落盘的投递位置删除日志段，崩溃重启后不会丢失未投递的消息
+            drop_segments(_saved_committed);
+        }
+
+        // 后台投递线程：按提交顺序发出消息，限制在途数量与速率
+        // 出现失败时暂停，等待已发出的消息全部完成后，从第一条未确认的消息开始重发
+        void drain_loop() {
+            auto next_send = std::chrono::steady_clock::now();
+            auto interval = _options.max_rate > 0 ? std::chrono::nanoseconds(1000000000 / _options.max_rate)
+                                                  : std::chrono::nanoseconds(0);
+            std::unique_lock<std::mutex> lock(_mtx);
+            while (_running) {
+                if (_failed) {
+                    _cond.wait(lock, [this]() { return !_running || _in_flight == 0; });
+                    if (!_running) break;
+                    _cond.wait_for(lock, std::chrono::milliseconds(_options.retry_interval_ms), [this]() { return !_running; });
+                    for (auto &entry : _pending) entry.sent = false;
+                    _next = 0;
+                    _failed = false;
+                    _retries << 1;
+                    continue;
+                }
+                if (_next >= _pending.size() || _in_flight >= _options.max_in_flight) {
+                    _cond.wait(lock);
+                    continue;
+                }
+                auto now = std::chrono::steady_clock::now();
+                if (now < next_send) {
+                    _cond.wait_until(lock, next_send);
+                    continue;
+                }
+                next_send = std::max(next_send + interval, now - std::chrono::milliseconds(100));
+
+                Entry &entry = _pending[_next++];
+                if (entry.acked) continue;
+                entry.sent = true;
+                ++_in_flight;
+                uint64_t seq = entry.seq;
+                std::string exchange = entry.exchange, msg = entry.msg, routing_key = entry.routing_key;
+                lock.unlock();
+                _publish(exchange, msg, routing_key, [link = _link, seq](bool ok) {
+                    std::unique_lock<std::mutex> link_lock(link->mtx);
+                    if (link->outbox) link->outbox->on_complete(seq, ok);
+                });
+                lock.lock();
+            }
+        }
+
+        // 投递完成回调（在消息队列客户端的事件循环线程中执行）
+        void on_complete(uint64_t seq, bool ok) {
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                --_in_flight;
+                if (!ok) {
+                    _failed = true;
+                } else if (!_pending.empty() && seq >= _pending.front().seq) {
+                    _pending[seq - _pending.front().seq].acked = true;
+                    _delivered << 1;
+                    // 从头部开始连续投递成功的消息可以出队，已投递位置随之前移
+                    while (!_pending.empty() && _pending.front().acked) {
+                        _committed = _pending.front().seq;
+                        _bytes -= _pending.front().msg.size();
+                        _pending.pop_front();
+                        if (_next > 0) --_next;
+                    }
+                }
+            }
+            _cond.notify_all();
+        }
+
+        static int64_t get_depth(void *arg) {
+            MQOutbox *outbox = static_cast<MQOutbox *>(arg);
+            std::unique_lock<std::mutex> lock(outbox->_mtx);
+            return outbox->_pending.size();
+        }
+        static int64_t get_age(void *arg) {
+            MQOutbox *outbox = static_cast<MQOutbox *>(arg);
+            std::unique_lock<std::mutex> lock(outbox->_mtx);
+            return outbox->_pending.empty() ? 0 : now_ms() - outbox->_pending.front().ts_ms;
+        }
+        static int64_t get_bytes(void *arg) {
+            MQOutbox *outbox = static_cast<MQOutbox *>(arg);
+            std::unique_lock<std::mutex> lock(outbox->_mtx);
+            return outbox->_bytes;
+        }
+    private:
+        PublishFunc _publish;
+        OutboxOptions _options;
+
+        std::mutex _mtx;
+        std::condition_variable _cond;        // 投递线程等待新消息、在途名额或重试
+        std::condition_variable _flush_cond;
+        bool _running = true;
+        std::deque<Entry> _pending;           // 尚未投递成功的消息，按序号递增
+        size_t _next = 0;                     // 下一条要发出的消息在 _pending 中的下标
+        size_t _in_flight = 0;                // 已发出但尚未完成的消息数
+        bool _failed = false;                 // 是否有消息投递失败，需要暂停后重发
+        uint64_t _seq = 0;                    // 最近一条消息的序号
+        uint64_t _committed = 0;              // 该序号及之前的消息都已投递成功
+        size_t _bytes = 0;                    // 积压消息总大小
+        std::string _buffer;                  // 尚未写盘的日志记录
+
+        // 以下几项只在写盘线程（及构造、析构）中访问
+        int _fd = -1;                         // 当前日志段（_segments 的最后一段），打开或写入失败时为 -1
+        std::deque<Segment> _segments;
+        uint64_t _saved_committed = 0;
+        uint64_t _flushed = 0;                // 该序号及之前的记录都已写入日志
+        std::chrono::steady_clock::time_point _next_open; // 日志段不可用时，下次重试创建的时间
+
+        bvar::PassiveStatus<int64_t> _depth;       // 积压消息数
+        bvar::PassiveStatus<int64_t> _age;         // 最早一条积压消息已等待的时间（毫秒）
+        bvar::PassiveStatus<int64_t> _spool_bytes; // 积压消息总大小
+        bvar::Adder<int64_t> _delivered;
+        bvar::Adder<int64_t> _retries;
+        bvar::Adder<int64_t> _rejected;
+        bvar::Adder<int64_t> _write_errors;        // 日志段不可用或写盘失败的次数，失败的记录留在内存中等待重试
+
+        std::shared_ptr<Link> _link;
+
+        std::thread _flush_thread;
+        std::thread _drain_thread;
+    };
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <openssl/evp.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#include <openssl/crypto.h>
+#include <string>
+#include <ctime>
+#include <cstdint>
+
+namespace liren
+{
+    // SessionToken 类实现无状态的签名会话令牌
+    // 令牌格式：v1.<base64url(uid \n ssid \n 过期时间)>.<base64url(HMAC-SHA256)>
+    // 持有相同密钥的任意服务都可以在本地校验令牌并取出用户ID，不需要访问 Redis
+    class SessionToken
+    {
+    public:
+        // 令牌中携带的信息
+        struct Claims
+        {
+            std::string uid;       // 用户ID
+            std::string ssid;      // 会话ID，注销时作为吊销列表中的标识
+            int64_t expire_at = 0; // 过期时间（秒级时间戳）
+        };
+
+        // 构造时用密钥初始化一个 HMAC 上下文模板，之后每次计算只复制模板，省去按名称查找算法与处理密钥的开销
+        explicit SessionToken(const std::string &secret)
+            : _secret(secret)
+        {
+            EVP_MAC *mac = EVP_MAC_fetch(nullptr, "HMAC", nullptr);
+            _ctx = EVP_MAC_CTX_new(mac);
+            EVP_MAC_free(mac);
+            char digest[] = "SHA256";
+            OSSL_PARAM params[] = {
+                OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+                OSSL_PARAM_construct_end()
+            };
+            EVP_MAC_init(_ctx, reinterpret_cast<const unsigned char *>(_secret.data()), _secret.size(), params);
+        }
+        ~SessionToken() { EVP_MAC_CTX_free(_ctx); }
+        SessionToken(const SessionToken &) = delete;
+        SessionToken &operator=(const SessionToken &) = delete;
+
+        // 判断字符串是否为签名令牌（而不是普通会话ID）
+        static bool is_token(const std::string &str) {
+            return str.compare(0, PREFIX.size(), PREFIX) == 0;
+        }
+
+        // 签发令牌
+        std::string sign(const std::string &uid, const std::string &ssid, int64_t expire_at) const {
+            std::string body = PREFIX + base64url_encode(uid + "\n" + ssid + "\n" + std::to_string(expire_at));
+            return body + "." + base64url_encode(hmac(body));
+        }
+
+        // 校验令牌签名与有效期，成功时输出令牌中携带的信息
+        bool verify(const std::string &token, Claims &claims, int64_t now = time(nullptr)) const {
+            if (!is_token(token)) return false;
+            size_t dot = token.rfind('.');
+            if (dot == std::string::npos || dot < PREFIX.size()) return false;
+            std::string body = token.substr(0, dot);
+            std::string sig, payload;
+            if (!base64url_decode(token.substr(dot + 1), sig)) return false;
+            std::string expect = hmac(body);
+            // 使用固定时间比较，避免通过响应时间逐字节猜测签名
+            if (sig.size() != expect.size() || CRYPTO_memcmp(sig.data(), expect.data(), sig.size()) != 0) return false;
+            if (!base64url_decode(body.substr(PREFIX.size()), payload)) return false;
+
+            size_t p1 = payload.find('\n');
+            if (p1 == std::string::npos) return false;
+            size_t p2 = payload.find('\n', p1 + 1);
+            if (p2 == std::string::npos) return false;
+            claims.uid = payload.substr(0, p1);
+            claims.ssid = payload.substr(p1 + 1, p2 - p1 - 1);
+            try {
+                claims.expire_at = std::stoll(payload.substr(p2 + 1));
+            } catch (...) {
+                return false;
+            }
+            return claims.expire_at > now;
+        }
+    private:
+        std::string hmac(const std::string &data) const {
+            unsigned char out[EVP_MAX_MD_SIZE];
+            size_t len = 0;
+            EVP_MAC_CTX *ctx = EVP_MAC_CTX_dup(_ctx);
+            EVP_MAC_update(ctx, reinterpret_cast<const unsigned char *>(data.data()), data.size());
+            EVP_MAC_final(ctx, out, &len, sizeof(out));
+            EVP_MAC_CTX_free(ctx);
+            return std::string(reinterpret_cast<char *>(out), len);
+        }
+
+        static std::string base64url_encode(const std::string &in) {
+            static const char *table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+            std::string out;
+            out.reserve((in.size() + 2) / 3 * 4);
+            uint32_t val = 0;
+            int bits = 0;
+            for (unsigned char c : in) {
+                val = (val << 8) | c;
+                bits += 8;
+                while (bits >= 6) {
+                    bits -= 6;
+                    out.push_back(table[(val >> bits) & 0x3F]);
+                }
+            }
+            if (bits > 0) out.push_back(table[(val << (6 - bits)) & 0x3F]);
+            return out;
+        }
+
+        static bool base64url_decode(const std::string &in, std::string &out) {
+            out.clear();
+            uint32_t val = 0;
+            int bits = 0;
+            for (char c : in) {
+                int d;
+                if (c >= 'A' && c <= 'Z') d = c - 'A';
+                else if (c >= 'a' && c <= 'z') d = c - 'a' + 26;
+                else if (c >= '0' && c <= '9') d = c - '0' + 52;
+                else if (c == '-') d = 62;
+                else if (c == '_') d = 63;
+                else return false;
+                val = (val << 6) | d;
+                bits += 6;
+                if (bits >= 8) {
+                    bits -= 8;
+                    out.push_back(static_cast<char>((val >> bits) & 0xFF));
+                }
+            }
+            return true;
+        }
+    private:
+        static inline const std::string PREFIX = "v1.";
+        std::string _secret; // 签名密钥，所有需要校验令牌的服务使用同一密钥
+        EVP_MAC_CTX *_ctx;   // 已设置密钥的 HMAC-SHA256 上下文模板，只读，可被多个线程同时复制
+    };
+}
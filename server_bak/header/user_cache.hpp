@@ -0,0 +1,364 @@
+#pragma once
+#include <list>
+#include <bthread/countdown_event.h>
+#include "mysql_user.hpp"  // 用户表操作
+#include "data_redis.hpp"  // Redis 客户端封装
+
+namespace liren
+{
+    // UserCache 的可选参数
+    struct UserCacheOptions
+    {
+        std::chrono::milliseconds local_ttl{5000};      // 进程内缓存有效期；其他进程修改用户后依靠失效通知清除，通知丢失时最多读到这么久的旧数据
+        size_t local_capacity = 100000;                 // 进程内缓存最多保存的用户数
+        std::chrono::milliseconds redis_ttl{600000};    // Redis 缓存有效期
+        std::chrono::milliseconds negative_ttl{30000};  // 不存在的用户ID的缓存有效期，避免无效ID反复查询 MySQL
+        std::string invalidate_channel = "user_invalidate"; // 用户缓存失效通知频道
+        std::string metrics_prefix = "user_cache";          // bvar 指标名称前缀
+    };
+
+    // 用户信息的两级读穿缓存：进程内分段 LRU -> Redis 哈希 -> MySQL
+    //   1. 同一用户ID同时未命中时只有一个调用者查询下一级，其余调用者等待其结果（single-flight）
+    //   2. 不存在的用户ID同样缓存，有效期为 negative_ttl
+    //   3. 注册为 UserTable 的变更回调：insert/update 成功后删除 Redis 缓存，并通过发布订阅通知所有进程清除进程内缓存
+    //   4. 回填读 MySQL 主库，从库延迟不会把旧数据写回缓存；查询失败时不缓存，只向调用方返回失败
+    //   5. 每个用户有一个失效版本键 user_ver:{uid}，每次失效加一；回填前读取版本，
+    //      写入 Redis 的脚本发现版本已变化（查询期间其他进程修改并失效了该用户）时放弃写入
+    // get 返回用户对象的副本，调用方修改后可以直接交给 UserTable::update
+    class UserCache
+    {
+    public:
+        using ptr = std::shared_ptr<UserCache>;
+
+        UserCache(const UserTable::ptr &user_table,
+                  const RedisClient::ptr &redis_client,
+                  const UserCacheOptions &options = UserCacheOptions())
+            : _user_table(user_table)
+            , _redis_client(redis_client)
+            , _options(options)
+            , _local(std::make_shared<LocalCache>(options.local_capacity))
+            , _hit_ratio(get_hit_ratio, this)
+        {
+            _get_latency.expose_as(_options.metrics_prefix, "get");
+            _load_latency.expose_as(_options.metrics_prefix, "load");
+            _local_hits.expose_as(_options.metrics_prefix, "local_hits");
+            _redis_hits.expose_as(_options.metrics_prefix, "redis_hits");
+            _misses.expose_as(_options.metrics_prefix, "misses");
+            _hit_ratio.expose_as(_options.metrics_prefix, "hit_ratio");
+
+            // 回调只持有进程内缓存的弱引用，UserCache 析构后回调只删除 Redis 缓存
+            std::weak_ptr<LocalCache> weak = _local;
+            RedisClient::ptr redis = _redis_client;
+            std::string channel = _options.invalidate_channel;
+            std::chrono::milliseconds version_ttl = _options.redis_ttl;
+            _user_table->on_change([weak, redis, channel, version_ttl](const std::string &uid) {
+                auto local = weak.lock();
+                if (local) local->erase(uid);
+                invalidate(redis, channel, version_ttl, uid);
+            });
+            subscribe();
+        }
+
+        ~UserCache() {
+            _user_table->on_change(nullptr);
+        }
+
+        // 根据用户ID获取用户信息
+        // 返回值：查询失败返回 false；用户不存在时返回 true 且 user 为空
+        bool get(const std::string &uid, std::shared_ptr<User> &user) {
+            auto start = std::chrono::steady_clock::now();
+            std::shared_ptr<User> res;
+            bool ret = lookup(uid, res);
+            _get_latency << std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            // 返回副本：缓存中的对象被多个请求共享，不能交给调用方修改
+            user = res ? std::make_shared<User>(*res) : nullptr;
+            return ret;
+        }
+
+        // 清除用户缓存，UserTable 之外的途径修改用户记录后调用
+        void invalidate(const std::string &uid) {
+            _local->erase(uid);
+            invalidate(_redis_client, _options.invalidate_channel, _options.redis_ttl, uid);
+        }
+
+    private:
+        // 缓存条目，user 为空表示该用户ID不存在
+        struct Entry
+        {
+            std::shared_ptr<User> user;
+            std::chrono::steady_clock::time_point expire_at;
+        };
+
+        // 一次正在进行的加载
+        struct Flight
+        {
+            bthread::CountdownEvent event{1};
+            bool ok = false;  // 加载是否成功
+            std::shared_ptr<User> user;
+        };
+
+        // 分段加锁的 LRU 缓存
+        class LocalCache
+        {
+        public:
+            explicit LocalCache(size_t capacity) : _capacity(capacity / SHARDS + 1) {}
+
+            bool get(const std::string &uid, Entry &entry) {
+                Shard &shard = _shards[std::hash<std::string>()(uid) % SHARDS];
+                std::unique_lock<std::mutex> lock(shard.mtx);
+                auto it = shard.index.find(uid);
+                if (it == shard.index.end()) return false;
+                if (std::chrono::steady_clock::now() >= it->second->second.expire_at) {
+                    shard.lru.erase(it->second);
+                    shard.index.erase(it);
+                    return false;
+                }
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second); // 移到链表头部
+                entry = it->second->second;
+                return true;
+            }
+            // generation 为调用方开始查询时的失效版本，查询期间该分段有过失效时放弃写入，避免旧数据覆盖失效结果
+            void put(const std::string &uid, const Entry &entry, uint64_t generation) {
+                Shard &shard = _shards[std::hash<std::string>()(uid) % SHARDS];
+                std::unique_lock<std::mutex> lock(shard.mtx);
+                if (shard.generation != generation) return;
+                auto it = shard.index.find(uid);
+                if (it != shard.index.end()) {
+                    it->second->second = entry;
+                    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                    return;
+                }
+                if (shard.lru.size() >= _capacity) {
+                    shard.index.erase(shard.lru.back().first);
+                    shard.lru.pop_back();
+                }
+                shard.lru.emplace_front(uid, entry);
+                shard.index[uid] = shard.lru.begin();
+            }
+            void erase(const std::string &uid) {
+                Shard &shard = _shards[std::hash<std::string>()(uid) % SHARDS];
+                std::unique_lock<std::mutex> lock(shard.mtx);
+                ++shard.generation;
+                auto it = shard.index.find(uid);
+                if (it == shard.index.end()) return;
+                shard.lru.erase(it->second);
+                shard.index.erase(it);
+            }
+            uint64_t generation(const std::string &uid) {
+                Shard &shard = _shards[std::hash<std::string>()(uid) % SHARDS];
+                std::unique_lock<std::mutex> lock(shard.mtx);
+                return shard.generation;
+            }
+        private:
+            static const size_t SHARDS = 16;
+            using List = std::list<std::pair<std::string, Entry>>;
+            struct Shard
+            {
+                std::mutex mtx;
+                List lru;                                                // 链表头部为最近访问的条目
+                std::unordered_map<std::string, List::iterator> index;
+                uint64_t generation = 0;                                 // 失效版本，每次 erase 加一
+            };
+            size_t _capacity;  // 每个分段的容量
+            Shard _shards[SHARDS];
+        };
+
+        // 依次查询进程内缓存、Redis 与 MySQL，查询失败返回 false
+        bool lookup(const std::string &uid, std::shared_ptr<User> &user) {
+            Entry entry;
+            if (_local->get(uid, entry)) {
+                _local_hits << 1;
+                user = entry.user;
+                return true;
+            }
+
+            // single-flight：第一个未命中的调用者负责加载，其余调用者等待同一个结果
+            // 等待使用 bthread 感知的事件，在 brpc 处理函数中等待只挂起当前 bthread
+            std::shared_ptr<Flight> flight;
+            {
+                std::unique_lock<std::mutex> lock(_flight_mtx);
+                auto it = _flights.find(uid);
+                if (it != _flights.end()) {
+                    flight = it->second;
+                    lock.unlock();
+                    flight->event.wait();
+                    user = flight->user;
+                    return flight->ok;
+                }
+                flight = std::make_shared<Flight>();
+                _flights[uid] = flight;
+            }
+            try {
+                flight->ok = load(uid, flight->user);
+            } catch (...) {
+                LOG_ERROR("加载用户 {} 信息失败", uid);
+            }
+            {
+                std::unique_lock<std::mutex> lock(_flight_mtx);
+                _flights.erase(uid);
+            }
+            flight->event.signal();
+            user = flight->user;
+            return flight->ok;
+        }
+
+        // 进程内缓存未命中：先查 Redis，再查 MySQL 主库并回填两级缓存
+        // MySQL 查询失败时返回 false，不写入任何缓存，避免把存在的用户缓存为不存在
+        bool load(const std::string &uid, std::shared_ptr<User> &user) {
+            uint64_t generation = _local->generation(uid);
+            auto now = std::chrono::steady_clock::now();
+            std::string key = RedisKey::user(uid);
+            std::string version_key = RedisKey::user_version(uid);
+            std::unordered_map<std::string, std::string> fields;
+            sw::redis::OptionalString version;
+            bool redis_ok = true;
+            try {
+                // 与缓存内容一起读取失效版本，回填时用于判断查询期间是否发生过失效
+                _redis_client->call("user_cache_get", [&](auto &redis) {
+                    redis.hgetall(key, std::inserter(fields, fields.begin()));
+                    version = redis.get(version_key);
+                    return true;
+                });
+            } catch (const std::exception &e) {
+                // Redis 不可用时直接查询 MySQL，结果不写入 Redis
+                LOG_WARN("查询用户缓存 {} 失败: {}", uid, e.what());
+                fields.clear();
+                redis_ok = false;
+            }
+            if (!fields.empty()) {
+                _redis_hits << 1;
+                user = decode(uid, fields);
+                _local->put(uid, Entry{user, now + (user ? _options.local_ttl : _options.negative_ttl)}, generation);
+                return true;
+            }
+
+            _misses << 1;
+            auto start = std::chrono::steady_clock::now();
+            bool ret = _user_table->find_by_id(uid, user);
+            _load_latency << std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            if (!ret) return false;
+            // 查询期间本进程失效过该用户，本次结果可能是旧数据，只返回不回填
+            if (_local->generation(uid) != generation) return true;
+            if (redis_ok) {
+                try {
+                    static RedisScript script(fill_script());
+                    std::vector<std::string> keys = {key, version_key};
+                    std::vector<std::string> args = {version ? *version : "0",
+                        std::to_string((user ? _options.redis_ttl : _options.negative_ttl).count())};
+                    for (auto &value : encode(user)) {
+                        args.push_back(value.first);
+                        args.push_back(value.second);
+                    }
+                    _redis_client->call("user_cache_set", [&](auto &redis) {
+                        return script.run<long long>(redis, keys, args);
+                    });
+                } catch (const std::exception &e) {
+                    LOG_WARN("写入用户缓存 {} 失败: {}", uid, e.what());
+                }
+            }
+            _local->put(uid, Entry{user, now + (user ? _options.local_ttl : _options.negative_ttl)}, generation);
+            return true;
+        }
+
+        // KEYS[1]: 用户缓存键, KEYS[2]: 失效版本键
+        // ARGV[1]: 查询 MySQL 前读到的版本, ARGV[2]: 有效期毫秒数, ARGV[3...]: 字段与值
+        // 版本已变化说明查询期间有进程修改并失效了该用户，放弃写入
+        static std::string fill_script() {
+            return "local version = redis.call('GET', KEYS[2]) or '0' "
+                   "if version ~= ARGV[1] then return 0 end "
+                   "redis.call('DEL', KEYS[1]) "
+                   "redis.call('HSET', KEYS[1], unpack(ARGV, 3)) "
+                   "redis.call('PEXPIRE', KEYS[1], ARGV[2]) "
+                   "return 1";
+        }
+
+        // Redis 哈希中只保存非空字段；不存在的用户ID保存为只有 missing 字段的哈希
+        static std::vector<std::pair<std::string, std::string>> encode(const std::shared_ptr<User> &user) {
+            std::vector<std::pair<std::string, std::string>> values;
+            if (!user) {
+                values.emplace_back("missing", "1");
+                return values;
+            }
+            values.emplace_back("id", std::to_string(user->id()));
+            if (!user->nickname().empty()) values.emplace_back("nickname", user->nickname());
+            if (!user->description().empty()) values.emplace_back("description", user->description());
+            if (!user->password().empty()) values.emplace_back("password", user->password());
+            if (!user->phone().empty()) values.emplace_back("phone", user->phone());
+            if (!user->avatar_id().empty()) values.emplace_back("avatar_id", user->avatar_id());
+            return values;
+        }
+
+        static std::shared_ptr<User> decode(const std::string &uid, const std::unordered_map<std::string, std::string> &fields) {
+            auto id = fields.find("id");
+            if (id == fields.end()) return nullptr;
+            auto user = std::make_shared<User>();
+            user->user_id(uid);
+            user->id(std::stoul(id->second));
+            for (auto &field : fields) {
+                if (field.first == "nickname") user->nickname(field.second);
+                else if (field.first == "description") user->description(field.second);
+                else if (field.first == "password") user->password(field.second);
+                else if (field.first == "phone") user->phone(field.second);
+                else if (field.first == "avatar_id") user->avatar_id(field.second);
+            }
+            return user;
+        }
+
+        // 增加失效版本、删除 Redis 缓存并通知所有进程清除进程内缓存
+        // 版本键的有效期与缓存相同，只需要覆盖正在进行的回填
+        static void invalidate(const RedisClient::ptr &redis, const std::string &channel,
+                               std::chrono::milliseconds version_ttl, const std::string &uid) {
+            std::string key = RedisKey::user(uid);
+            std::string version_key = RedisKey::user_version(uid);
+            try {
+                redis->call("user_cache_del_publish", [&](auto &) {
+                    return redis->pipeline(uid)
+                        .incr(version_key)
+                        .pexpire(version_key, version_ttl)
+                        .del(key)
+                        .publish(channel, uid)
+                        .exec();
+                });
+            } catch (const std::exception &e) {
+                LOG_ERROR("清除用户缓存 {} 失败: {}", uid, e.what());
+            }
+        }
+
+        // 订阅失效频道，收到通知后清除进程内缓存；订阅线程在 UserCache 析构时停止
+        void subscribe() {
+            std::weak_ptr<LocalCache> weak = _local;
+            _subscriber = std::make_shared<RedisSubscriber>(_redis_client, _options.invalidate_channel,
+                [weak](const std::string &uid) {
+                    auto local = weak.lock();
+                    if (local) local->erase(uid);
+                });
+        }
+
+        // 命中率：命中进程内缓存或 Redis 的查询占全部查询的比例
+        static double get_hit_ratio(void *arg) {
+            UserCache *cache = static_cast<UserCache *>(arg);
+            int64_t hits = cache->_local_hits.get_value() + cache->_redis_hits.get_value();
+            int64_t total = hits + cache->_misses.get_value();
+            return total == 0 ? 0 : static_cast<double>(hits) / total;
+        }
+    private:
+        UserTable::ptr _user_table;
+        RedisClient::ptr _redis_client;
+        UserCacheOptions _options;
+        std::shared_ptr<LocalCache> _local;  // 进程内缓存
+
+        std::mutex _flight_mtx;
+        std::unordered_map<std::string, std::shared_ptr<Flight>> _flights; // 正在加载的用户ID
+
+        bvar::LatencyRecorder _get_latency;    // get 耗时
+        bvar::LatencyRecorder _load_latency;   // 查询 MySQL 的耗时
+        bvar::Adder<int64_t> _local_hits;      // 命中进程内缓存的次数
+        bvar::Adder<int64_t> _redis_hits;      // 命中 Redis 的次数
+        bvar::Adder<int64_t> _misses;          // 查询 MySQL 的次数
+        bvar::PassiveStatus<double> _hit_ratio;
+
+        RedisSubscriber::ptr _subscriber;      // 失效频道的订阅线程，最先析构
+    };
+}
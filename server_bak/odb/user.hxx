@@ -5,7 +5,7 @@
 #include <odb/core.hxx>
 
 // mysql_test目录中的生成命令：
-//  odb -d mysql --std c++11 --generate-query --generate-schema --profile boost/date-time ../../../odb/user.hxx
+//  odb -d mysql --std c++11 --generate-query --generate-prepared --generate-schema --profile boost/date-time ../../../odb/user.hxx
 
 namespace liren 
 {
@@ -25,6 +25,10 @@ namespace liren
         {}
         
         // 下面是一系列设置以及获取字段的接口
+        // 数据库自增主键：缓存中的用户对象需要保留主键，之后才能用于 update
+        void id(unsigned long val) { _id = val; }
+        unsigned long id() const { return _id; }
+
         void user_id(const std::string &val) { _user_id = val; }
         std::string user_id() { return _user_id; }
 
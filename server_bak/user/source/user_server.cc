@@ -1,4 +1,5 @@
 #include "user_server.hpp"
+#include <sstream>
 
 DEFINE_bool(run_mode, false, "程序的运行模式，false-调试； true-发布；");
 DEFINE_string(log_file, "", "发布模式下，用于指定日志的输出文件");
@@ -7,13 +8,24 @@ DEFINE_int32(log_level, 0, "发布模式下，用于指定日志输出等级");
 DEFINE_string(registry_host, "http://127.0.0.1:2379", "服务注册中心地址");
 DEFINE_string(instance_name, "/user_service/instance", "当前实例名称");
 DEFINE_string(access_host, "127.0.0.1:10003", "当前实例的外部访问地址");
+DEFINE_int64(instance_weight, 100, "当前实例的路由权重，硬件配置越高权重越大");
+DEFINE_int32(instance_max_concurrency, 0, "当前实例的最大并发请求数，0表示不限制");
+DEFINE_string(build_version, "", "当前实例的构建版本");
+DEFINE_string(instance_zone, "", "当前实例所在机房，注册到服务中心并用于优先调用同机房的子服务节点");
 
 DEFINE_int32(listen_port, 10003, "Rpc服务器监听端口");
 DEFINE_int32(rpc_timeout, -1, "Rpc调用超时时间");
 DEFINE_int32(rpc_threads, 1, "Rpc的IO线程数量");
 
 DEFINE_string(base_service, "/service", "服务监控根目录");
+DEFINE_string(discovery_snapshot, "", "服务发现本地快照文件的绝对路径，为空表示不使用快照");
 DEFINE_string(file_service, "/service/file_service", "文件管理子服务名称");
+DEFINE_int32(file_connect_timeout_ms, 200, "文件子服务信道连接超时时间（毫秒），-1表示不限制");
+DEFINE_int32(file_timeout_ms, 2000, "文件子服务rpc调用超时时间（毫秒），-1表示不限制");
+DEFINE_int32(file_max_retry, 2, "文件子服务rpc调用最大重试次数");
+DEFINE_string(file_connection_type, "pooled", "文件子服务信道连接方式：single/pooled/short");
+DEFINE_int32(file_backup_request_ms, 100, "下载文件时等待多久（毫秒）后向另一个文件子服务节点发起备份请求，-1表示不发起");
+DEFINE_int64(channel_slow_start_ms, 30000, "新上线节点预热完成后，权重线性增长到满权重的时长（毫秒）");
 
 DEFINE_string(es_host, "http://127.0.0.1:9200/", "ES搜索引擎服务器URL");
 
@@ -24,11 +36,31 @@ DEFINE_string(mysql_db, "liren", "Mysql默认库名称");
 DEFINE_string(mysql_cset, "utf8", "Mysql客户端字符集");
 DEFINE_int32(mysql_port, 0, "Mysql服务器访问端口");
 DEFINE_int32(mysql_pool_count, 4, "Mysql连接池最大连接数量");
+DEFINE_string(mysql_replicas, "", "Mysql只读从库地址列表，以逗号分隔，每项为 host 或 host:port，为空表示读写都使用主库");
+DEFINE_int32(mysql_max_lag_sec, 1, "Mysql从库复制延迟超过该秒数时不再承担读请求");
+DEFINE_int32(mysql_pin_ms, 2000, "用户写入后其查询固定走主库的时长（毫秒），0表示不固定");
+DEFINE_bool(mysql_executor, true, "是否在独立线程池（线程数与连接池大小一致）中执行Mysql操作，避免阻塞brpc工作线程");
+DEFINE_string(mysql_shards, "", "用户表其余分片地址列表，以逗号分隔，每项为 host/db 或 host:port/db；mysql_host/mysql_db（及 mysql_replicas 从库）为第一个分片，其余分片不带从库，为空表示不分片");
+DEFINE_string(mysql_index, "", "用户昵称、手机号全局索引库地址（host/db 或 host:port/db），为空时使用第一个分片");
 
 DEFINE_string(redis_host, "127.0.0.1", "Redis服务器访问地址");
 DEFINE_int32(redis_port, 6379, "Redis服务器访问端口");
 DEFINE_int32(redis_db, 0, "Redis默认库号");
 DEFINE_bool(redis_keep_alive, true, "Redis长连接保活选项");
+DEFINE_bool(redis_cluster, false, "Redis是否为集群部署，集群模式下redis_host/redis_port指定任意一个集群节点即可");
+DEFINE_int32(redis_pool_size, 8, "Redis连接池大小（集群模式下为每个节点的连接池大小）");
+DEFINE_int32(redis_pool_wait_ms, 100, "Redis连接池耗尽时等待空闲连接的超时时间（毫秒），0表示一直等待");
+DEFINE_int32(redis_connection_lifetime_ms, 0, "Redis连接最长存活时间（毫秒），0表示不限制");
+DEFINE_int32(redis_connect_timeout_ms, 200, "Redis建立连接超时时间（毫秒），0表示不限制");
+DEFINE_int32(redis_socket_timeout_ms, 500, "Redis命令读写超时时间（毫秒），0表示不限制");
+DEFINE_int32(session_ttl_sec, 7 * 24 * 3600, "会话有效期（秒），每次访问自动续期，0表示永不过期");
+DEFINE_int32(session_cache_ms, 1000, "会话ID->用户ID进程内缓存有效期（毫秒），0表示不缓存");
+DEFINE_string(session_token_secret, "", "会话令牌签名密钥，非空时登录返回签名令牌，各服务可在本地校验而不访问Redis");
+DEFINE_int32(session_token_ttl_sec, 7 * 24 * 3600, "会话令牌有效期（秒）");
+DEFINE_int32(user_cache_local_ms, 5000, "用户信息进程内缓存有效期（毫秒）");
+DEFINE_int32(user_cache_capacity, 100000, "用户信息进程内缓存最多保存的用户数");
+DEFINE_int32(user_cache_redis_sec, 600, "用户信息Redis缓存有效期（秒）");
+DEFINE_int32(user_cache_negative_sec, 30, "不存在的用户ID的缓存有效期（秒）");
 
 DEFINE_string(dms_key_id, "LTAI5tGrJuae6eAfHmi9jiyg", "短信平台密钥ID");
 DEFINE_string(dms_key_secret, "hEdQhNgyEw7io6GvkTtz4y0VRnnnJv", "短信平台密钥");
@@ -41,12 +73,56 @@ int main(int argc, char *argv[])
     liren::UserServerBuilder usb;
     usb.make_dms_object(FLAGS_dms_key_id, FLAGS_dms_key_secret);
     usb.make_es_object({FLAGS_es_host});
+    std::vector<std::string> mysql_replicas;
+    std::stringstream replicas(FLAGS_mysql_replicas);
+    for (std::string replica; std::getline(replicas, replica, ',');) {
+        if (!replica.empty()) mysql_replicas.push_back(replica);
+    }
+    std::vector<std::string> mysql_shards;
+    std::stringstream shards(FLAGS_mysql_shards);
+    for (std::string shard; std::getline(shards, shard, ',');) {
+        if (!shard.empty()) mysql_shards.push_back(shard);
+    }
+    liren::ODBClusterOptions cluster_options;
+    cluster_options.max_lag_sec = FLAGS_mysql_max_lag_sec;
+    cluster_options.pin_ttl = std::chrono::milliseconds(FLAGS_mysql_pin_ms);
     usb.make_mysql_object(FLAGS_mysql_user, FLAGS_mysql_pswd, FLAGS_mysql_host, 
-        FLAGS_mysql_db, FLAGS_mysql_cset, FLAGS_mysql_port, FLAGS_mysql_pool_count);
-    usb.make_redis_object(FLAGS_redis_host, FLAGS_redis_port, FLAGS_redis_db, FLAGS_redis_keep_alive);
-    usb.make_discovery_object(FLAGS_registry_host, FLAGS_base_service, FLAGS_file_service);
-    usb.make_rpc_server(FLAGS_listen_port, FLAGS_rpc_timeout, FLAGS_rpc_threads);
-    usb.make_registry_object(FLAGS_registry_host, FLAGS_base_service + FLAGS_instance_name, FLAGS_access_host);
+        FLAGS_mysql_db, FLAGS_mysql_cset, FLAGS_mysql_port, FLAGS_mysql_pool_count,
+        mysql_replicas, cluster_options, FLAGS_mysql_executor, mysql_shards, FLAGS_mysql_index);
+    liren::SessionOptions session_options;
+    session_options.ttl = std::chrono::seconds(FLAGS_session_ttl_sec);
+    session_options.cache_ttl = std::chrono::milliseconds(FLAGS_session_cache_ms);
+    session_options.token_secret = FLAGS_session_token_secret;
+    session_options.token_ttl = std::chrono::seconds(FLAGS_session_token_ttl_sec);
+    liren::RedisOptions redis_options;
+    redis_options.pool_size = FLAGS_redis_pool_size;
+    redis_options.pool_wait_timeout = std::chrono::milliseconds(FLAGS_redis_pool_wait_ms);
+    redis_options.connection_lifetime = std::chrono::milliseconds(FLAGS_redis_connection_lifetime_ms);
+    redis_options.connect_timeout = std::chrono::milliseconds(FLAGS_redis_connect_timeout_ms);
+    redis_options.socket_timeout = std::chrono::milliseconds(FLAGS_redis_socket_timeout_ms);
+    usb.make_redis_object(FLAGS_redis_host, FLAGS_redis_port, FLAGS_redis_db, FLAGS_redis_keep_alive,
+        session_options, FLAGS_redis_cluster, redis_options);
+    liren::UserCacheOptions user_cache_options;
+    user_cache_options.local_ttl = std::chrono::milliseconds(FLAGS_user_cache_local_ms);
+    user_cache_options.local_capacity = FLAGS_user_cache_capacity;
+    user_cache_options.redis_ttl = std::chrono::seconds(FLAGS_user_cache_redis_sec);
+    user_cache_options.negative_ttl = std::chrono::seconds(FLAGS_user_cache_negative_sec);
+    usb.make_user_cache_object(user_cache_options);
+    liren::HealthOptions health_options;
+    health_options.slow_start_ms = FLAGS_channel_slow_start_ms;
+    usb.make_discovery_object(FLAGS_registry_host, FLAGS_base_service, FLAGS_file_service,
+        liren::make_channel_options(FLAGS_file_connect_timeout_ms, FLAGS_file_timeout_ms,
+            FLAGS_file_max_retry, FLAGS_file_connection_type),
+        health_options, FLAGS_discovery_snapshot, FLAGS_instance_zone, FLAGS_file_backup_request_ms);
+    usb.make_rpc_server(FLAGS_listen_port, FLAGS_rpc_timeout, FLAGS_rpc_threads, FLAGS_instance_max_concurrency);
+
+    liren::InstanceMeta meta;
+    meta.host = FLAGS_access_host;
+    meta.weight = FLAGS_instance_weight;
+    meta.max_concurrency = FLAGS_instance_max_concurrency;
+    meta.version = FLAGS_build_version;
+    meta.zone = FLAGS_instance_zone;
+    usb.make_registry_object(FLAGS_registry_host, FLAGS_base_service + FLAGS_instance_name, meta);
     auto server = usb.build();
     server->start();
     return 0;
@@ -8,6 +8,7 @@
 #include "data_es.hpp"      // es数据管理客户端封装
 #include "data_redis.hpp"   // redis数据管理客户端封装
 #include "mysql_user.hpp"   // mysql数据管理客户端封装
+#include "user_cache.hpp"   // 用户信息两级缓存
 #include "etcd.hpp"     // 服务注册模块封装
 #include "logger.hpp"   // 日志模块封装
 #include "utils.hpp"    // 基础工具接口
@@ -29,16 +30,23 @@ namespace liren
     public:
         UserServiceImpl(const DMSClient::ptr &dms_client, // 短信平台客户端
                         const std::shared_ptr<elasticlient::Client> &es_client, 
-                        const std::shared_ptr<odb::core::database> &mysql_client,
-                        const std::shared_ptr<sw::redis::Redis> &redis_client,
+                        const std::vector<ODBCluster::ptr> &mysql_shards, // 用户表分片，每个分片为主库与只读从库
+                        const ODBCluster::ptr &mysql_index,     // 昵称、手机号全局索引所在的库，只有一个分片时为空
+                        const Executor::ptr &mysql_executor,    // 执行MySQL操作的线程池，为空时在bthread中直接执行
+                        const RedisClient::ptr &redis_client,
                         const ServiceManager::ptr &channel_manager,  // brpc服务信道管理器
-                        const std::string &file_service_name) 
+                        const std::string &file_service_name,
+                        int32_t file_backup_request_ms,              // 下载文件时跨节点备份请求的等待时间，小于0表示不发起
+                        const SessionOptions &session_options = SessionOptions(),  // 会话有效期与近端缓存参数
+                        const UserCacheOptions &user_cache_options = UserCacheOptions()) // 用户信息缓存参数
             : _es_user(std::make_shared<ESUser>(es_client))
-            , _mysql_user(std::make_shared<UserTable>(mysql_client))
-            , _redis_session(std::make_shared<Session>(redis_client))
+            , _mysql_user(std::make_shared<UserTable>(mysql_shards, mysql_index, mysql_executor))
+            , _user_cache(std::make_shared<UserCache>(_mysql_user, redis_client, user_cache_options))
+            , _redis_session(std::make_shared<Session>(redis_client, session_options))
             , _redis_status(std::make_shared<Status>(redis_client))
             , _redis_codes(std::make_shared<Codes>(redis_client))
             , _file_service_name(file_service_name)
+            , _file_backup_request_ms(file_backup_request_ms)
             , _mm_channels(channel_manager)
             , _dms_client(dms_client)
         {
@@ -47,6 +55,20 @@ namespace liren
 
         ~UserServiceImpl(){}
 
+        // 更新 ES 中用户文档的单个字段；文档不存在（例如注册时写入 ES 失败）时从主库读取完整用户信息重新写入
+        bool update_es_field(const std::string &uid, const std::string &field, const std::string &val) {
+            bool missing = false;
+            if (_es_user->updateField(uid, field, val, &missing)) return true;
+            if (!missing) return false;
+            std::shared_ptr<User> user;
+            if (!_mysql_user->find_by_id(uid, user) || !user) {
+                LOG_ERROR("重建用户 {} 的搜索引擎数据失败，未能从数据库读取用户信息！", uid);
+                return false;
+            }
+            return _es_user->appendData(user->user_id(), user->phone(), user->nickname(),
+                                        user->description(), user->avatar_id());
+        }
+
         bool nickname_check(const std::string &nickname) {
             return nickname.size() < 22;
         }
@@ -156,23 +178,17 @@ namespace liren
                 return err_response(request->request_id(), "用户名或密码错误!");
             }
 
-            // 3. 根据 redis 中的登录标记信息是否存在判断用户是否已经登录。
-            bool ret = _redis_status->exists(user->user_id());
-            if (ret == true) {
+            // 3. 构造会话 ID，在 redis 中一次性完成：判断用户是否已经登录 -> 添加会话信息 -> 添加登录标记信息
+            std::string ssid = RedisKey::make_ssid(user->user_id(), uuid());
+            LoginResult ret = _redis_session->login(ssid, user->user_id());
+            if (ret == LoginResult::ALREADY_ONLINE) {
                 LOG_ERROR("{} - 用户已在其他地方登录 - {}！", request->request_id(), nickname);
                 return err_response(request->request_id(), "用户已在其他地方登录!");
             }
 
-            // 4. 构造会话 ID，生成会话键值对，向 redis 中添加会话信息以及登录标记信息
-            std::string ssid = uuid();
-            _redis_session->append(ssid, user->user_id());
-
-            // 5. 添加用户登录信息
-            _redis_status->append(user->user_id());
-
-            // 6. 组织响应，返回生成的会话 ID
+            // 4. 组织响应，返回会话凭证（启用令牌时为签名令牌，否则为会话 ID）
             response->set_request_id(request->request_id());
-            response->set_login_session_id(ssid);
+            response->set_login_session_id(_redis_session->issue(ssid, user->user_id()));
             response->set_success(true);
         }
 
@@ -328,31 +344,22 @@ namespace liren
                 return err_response(request->request_id(), "该手机号未注册用户!");
             }
 
-            // 4. 从 redis 数据库中进行验证码 ID-验证码一致性匹配
-            auto vcode = _redis_codes->code(code_id);
-            if (vcode != code) {
+            // 4. 构造会话 ID，在 redis 中一次性完成：验证码 ID-验证码一致性匹配并删除验证码 -> 
+            //    判断用户是否已经登录 -> 添加会话信息 -> 添加登录标记信息
+            std::string ssid = RedisKey::make_ssid(user->user_id(), uuid());
+            LoginResult login_ret = _redis_session->login(ssid, user->user_id(), code_id, code);
+            if (login_ret == LoginResult::CODE_MISMATCH) {
                 LOG_ERROR("{} - 验证码错误 - {}-{}！", request->request_id(), code_id, code);
                 return err_response(request->request_id(), "验证码错误!");
             }
-            _redis_codes->remove(code_id);
-
-            // 5. 根据 redis 中的登录标记信息是否存在判断用户是否已经登录。
-            ret = _redis_status->exists(user->user_id());
-            if (ret == true) {
+            if (login_ret == LoginResult::ALREADY_ONLINE) {
                 LOG_ERROR("{} - 用户已在其他地方登录 - {}！", request->request_id(), phone);
                 return err_response(request->request_id(), "用户已在其他地方登录!");
             }
 
-            // 6. 构造会话 ID，生成会话键值对，向 redis 中添加会话信息以及登录标记信息
-            std::string ssid = uuid();
-            _redis_session->append(ssid, user->user_id());
-
-            // 7. 添加用户登录信息
-            _redis_status->append(user->user_id());
-
-            // 8. 组织响应，返回生成的会话 ID
+            // 5. 组织响应，返回会话凭证（启用令牌时为签名令牌，否则为会话 ID）
             response->set_request_id(request->request_id());
-            response->set_login_session_id(ssid);
+            response->set_login_session_id(_redis_session->issue(ssid, user->user_id()));
             response->set_success(true);
         }
 
@@ -376,7 +383,11 @@ namespace liren
             std::string uid = request->user_id();
 
             // 2. 通过用户 ID，从数据库中查询用户信息
-            auto user = _mysql_user->select_by_id(uid);
+            std::shared_ptr<User> user;
+            if (!_user_cache->get(uid, user)) {
+                LOG_ERROR("{} - 查询用户信息失败 - {}！", request->request_id(), uid);
+                return err_response(request->request_id(), "查询用户信息失败!");
+            }
             if (!user) {
                 LOG_ERROR("{} - 未找到用户信息 - {}！", request->request_id(), uid);
                 return err_response(request->request_id(), "未找到用户信息!");
@@ -390,24 +401,20 @@ namespace liren
             user_info->set_phone(user->phone());
             
             if (!user->avatar_id().empty()) {
-                // 从信道管理对象中，获取到连接了文件管理子服务的channel
-                auto channel = _mm_channels->getChannel(_file_service_name);
-                if (!channel) {
-                    LOG_ERROR("{} - 未找到文件管理子服务节点 - {} - {}！", 
-                        request->request_id(), _file_service_name, uid);
-                    return err_response(request->request_id(), "未找到文件管理子服务节点!");
-                }
-
-                // 进行文件子服务的rpc请求，进行头像文件下载
-                liren::FileService_Stub stub(channel.get());
+                // 进行文件子服务的rpc请求，进行头像文件下载（同一头像尽量落到同一节点，以命中节点上的缓存）
+                // 下载是幂等的，该节点迟迟不返回时向另一个节点发起备份请求
                 liren::GetSingleFileReq req;
                 liren::GetSingleFileRsp rsp;
                 req.set_request_id(request->request_id());
                 req.set_file_id(user->avatar_id());
-                brpc::Controller cntl;
-                stub.GetSingleFile(&cntl, &req, &rsp, nullptr);
-                if (cntl.Failed() == true || rsp.success() == false) {
-                    LOG_ERROR("{} - 文件子服务调用失败：{}！", request->request_id(), cntl.ErrorText());
+                std::string errmsg;
+                bool ok = _mm_channels->hedged_call(_file_service_name, user->avatar_id(), _file_backup_request_ms,
+                    [&req](brpc::Channel *channel, brpc::Controller *cntl, liren::GetSingleFileRsp *rsp,
+                           google::protobuf::Closure *done) {
+                        liren::FileService_Stub(channel).GetSingleFile(cntl, &req, rsp, done);
+                    }, &rsp, &errmsg);
+                if (ok == false || rsp.success() == false) {
+                    LOG_ERROR("{} - 文件子服务调用失败：{}！", request->request_id(), errmsg);
                     return err_response(request->request_id(), "文件子服务调用失败!");
                 }
                 user_info->set_avatar(rsp.file_data().file_content());
@@ -449,13 +456,7 @@ namespace liren
                 return err_response(request->request_id(), "从数据库查找的用户信息数量不一致!");
             }
 
-            // 4. 批量从文件管理子服务进行文件下载
-            auto channel = _mm_channels->getChannel(_file_service_name);
-            if (!channel) {
-                LOG_ERROR("{} - 未找到文件管理子服务节点 - {}！", request->request_id(), _file_service_name);
-                return err_response(request->request_id(), "未找到文件管理子服务节点!");
-            }
-            liren::FileService_Stub stub(channel.get());
+            // 4. 批量从文件管理子服务进行文件下载（幂等调用，节点迟迟不返回时向另一个节点发起备份请求）
             liren::GetMultiFileReq req;
             liren::GetMultiFileRsp rsp;
             req.set_request_id(request->request_id());
@@ -463,11 +464,15 @@ namespace liren
                 if (user.avatar_id().empty()) continue;
                 req.add_file_id_list(user.avatar_id());
             }
-            brpc::Controller cntl;
-            stub.GetMultiFile(&cntl, &req, &rsp, nullptr);
-            if (cntl.Failed() == true || rsp.success() == false) {
+            std::string errmsg;
+            bool ok = _mm_channels->hedged_call(_file_service_name, "", _file_backup_request_ms,
+                [&req](brpc::Channel *channel, brpc::Controller *cntl, liren::GetMultiFileRsp *rsp,
+                       google::protobuf::Closure *done) {
+                    liren::FileService_Stub(channel).GetMultiFile(cntl, &req, rsp, done);
+                }, &rsp, &errmsg);
+            if (ok == false || rsp.success() == false) {
                 LOG_ERROR("{} - 文件子服务调用失败：{} - {}！", request->request_id(), 
-                    _file_service_name, cntl.ErrorText());
+                    _file_service_name, errmsg);
                 return err_response(request->request_id(), "文件子服务调用失败!");
             }
 
@@ -506,14 +511,18 @@ namespace liren
             std::string uid = request->user_id();
 
             // 2. 从数据库通过用户 ID 进行用户信息查询，判断用户是否存在
-            auto user = _mysql_user->select_by_id(uid);
+            std::shared_ptr<User> user;
+            if (!_user_cache->get(uid, user)) {
+                LOG_ERROR("{} - 查询用户信息失败 - {}！", request->request_id(), uid);
+                return err_response(request->request_id(), "查询用户信息失败!");
+            }
             if (!user) {
                 LOG_ERROR("{} - 未找到用户信息 - {}！", request->request_id(), uid);
                 return err_response(request->request_id(), "未找到用户信息!");
             }
 
-            // 3. 上传头像文件到文件子服务
-            auto channel = _mm_channels->getChannel(_file_service_name);
+            // 3. 上传头像文件到文件子服务（同一用户的头像尽量落到同一节点）
+            auto channel = _mm_channels->getChannel(_file_service_name, uid);
             if (!channel) {
                 LOG_ERROR("{} - 未找到文件管理子服务节点 - {}！", request->request_id(), _file_service_name);
                 return err_response(request->request_id(), "未找到文件管理子服务节点!");
@@ -526,24 +535,28 @@ namespace liren
             req.mutable_file_data()->set_file_size(request->avatar().size());
             req.mutable_file_data()->set_file_content(request->avatar());
             brpc::Controller cntl;
+            cntl.set_max_retry(0); // 上传不是幂等的，重试可能生成重复的文件，不重试也不发起备份请求
             stub.PutSingleFile(&cntl, &req, &rsp, nullptr);
+            _mm_channels->feedback(_file_service_name, channel, cntl);
             if (cntl.Failed() == true || rsp.success() == false) {
                 LOG_ERROR("{} - 文件子服务调用失败：{}！", request->request_id(), cntl.ErrorText());
                 return err_response(request->request_id(), "文件子服务调用失败!");
             }
             std::string avatar_id = rsp.file_info().file_id();
 
-            // 4. 将返回的头像文件 ID 更新到数据库中
-            user->avatar_id(avatar_id);
-            bool ret = _mysql_user->update(user);
-            if (ret == false) {
+            // 4. 将返回的头像文件 ID 更新到数据库中（只更新头像ID一列）
+            UpdateResult res = _mysql_user->update_avatar(uid, avatar_id);
+            if (res == UpdateResult::NOT_FOUND) {
+                LOG_ERROR("{} - 未找到用户信息 - {}！", request->request_id(), uid);
+                return err_response(request->request_id(), "未找到用户信息!");
+            }
+            if (res != UpdateResult::OK) {
                 LOG_ERROR("{} - 更新数据库用户头像ID失败 ：{}！", request->request_id(), avatar_id);
                 return err_response(request->request_id(), "更新数据库用户头像ID失败!");
             }
 
             // 5. 更新 ES 服务器中用户信息
-            ret = _es_user->appendData(user->user_id(), user->phone(),
-                user->nickname(), user->description(), user->avatar_id());
+            bool ret = update_es_field(uid, "avatar_id", avatar_id);
             if (ret == false) {
                 LOG_ERROR("{} - 更新搜索引擎用户头像ID失败 ：{}！", request->request_id(), avatar_id);
                 return err_response(request->request_id(), "更新搜索引擎用户头像ID失败!");
@@ -580,30 +593,29 @@ namespace liren
                 return err_response(request->request_id(), "用户名长度不合法！");
             }
 
-            // 3. 从数据库通过用户 ID 进行用户信息查询，判断用户是否存在
-            auto user = _mysql_user->select_by_id(uid);
-            if (!user) {
+            // 3. 将新的昵称更新到数据库中，用户是否存在由更新结果判断
+            UpdateResult res = _mysql_user->update_nickname(uid, new_nickname);
+            if (res == UpdateResult::NOT_FOUND) {
                 LOG_ERROR("{} - 未找到用户信息 - {}！", request->request_id(), uid);
                 return err_response(request->request_id(), "未找到用户信息!");
             }
-
-            // 4. 将新的昵称更新到数据库中
-            user->nickname(new_nickname);
-            ret = _mysql_user->update(user);
-            if (ret == false) {
+            if (res == UpdateResult::CONFLICT) {
+                LOG_ERROR("{} - 用户名被占用 - {}！", request->request_id(), new_nickname);
+                return err_response(request->request_id(), "用户名被占用!");
+            }
+            if (res != UpdateResult::OK) {
                 LOG_ERROR("{} - 更新数据库用户昵称失败 ：{}！", request->request_id(), new_nickname);
                 return err_response(request->request_id(), "更新数据库用户昵称失败!");
             }
 
-            // 5. 更新 ES 服务器中用户信息
-            ret = _es_user->appendData(user->user_id(), user->phone(),
-                user->nickname(), user->description(), user->avatar_id());
+            // 4. 更新 ES 服务器中用户信息
+            ret = update_es_field(uid, "nickname", new_nickname);
             if (ret == false) {
                 LOG_ERROR("{} - 更新搜索引擎用户昵称失败 ：{}！", request->request_id(), new_nickname);
                 return err_response(request->request_id(), "更新搜索引擎用户昵称失败!");
             }
 
-            // 6. 组织响应，返回更新成功与否
+            // 5. 组织响应，返回更新成功与否
             response->set_request_id(request->request_id());
             response->set_success(true);
         }
@@ -627,30 +639,25 @@ namespace liren
             std::string uid = request->user_id();
             std::string new_description = request->description();
 
-            // 3. 从数据库通过用户 ID 进行用户信息查询，判断用户是否存在
-            auto user = _mysql_user->select_by_id(uid);
-            if (!user) {
+            // 3. 将新的签名更新到数据库中，用户是否存在由更新结果判断
+            UpdateResult res = _mysql_user->update_description(uid, new_description);
+            if (res == UpdateResult::NOT_FOUND) {
                 LOG_ERROR("{} - 未找到用户信息 - {}！", request->request_id(), uid);
                 return err_response(request->request_id(), "未找到用户信息!");
             }
-
-            // 4. 将新的昵称更新到数据库中
-            user->description(new_description);
-            bool ret = _mysql_user->update(user);
-            if (ret == false) {
+            if (res != UpdateResult::OK) {
                 LOG_ERROR("{} - 更新数据库用户签名失败 ：{}！", request->request_id(), new_description);
                 return err_response(request->request_id(), "更新数据库用户签名失败!");
             }
 
-            // 5. 更新 ES 服务器中用户信息
-            ret = _es_user->appendData(user->user_id(), user->phone(),
-                user->nickname(), user->description(), user->avatar_id());
+            // 4. 更新 ES 服务器中用户信息
+            bool ret = update_es_field(uid, "description", new_description);
             if (ret == false) {
                 LOG_ERROR("{} - 更新搜索引擎用户签名失败 ：{}！", request->request_id(), new_description);
                 return err_response(request->request_id(), "更新搜索引擎用户签名失败!");
             }
 
-            // 6. 组织响应，返回更新成功与否
+            // 5. 组织响应，返回更新成功与否
             response->set_request_id(request->request_id());
             response->set_success(true);
         }
@@ -683,30 +690,29 @@ namespace liren
                 return err_response(request->request_id(), "验证码错误!");
             }
 
-            // 3. 从数据库通过用户 ID 进行用户信息查询，判断用户是否存在
-            auto user = _mysql_user->select_by_id(uid);
-            if (!user) {
+            // 3. 将新的手机号更新到数据库中，用户是否存在由更新结果判断
+            UpdateResult res = _mysql_user->update_phone(uid, new_phone);
+            if (res == UpdateResult::NOT_FOUND) {
                 LOG_ERROR("{} - 未找到用户信息 - {}！", request->request_id(), uid);
                 return err_response(request->request_id(), "未找到用户信息!");
             }
-
-            // 4. 将新的昵称更新到数据库中
-            user->phone(new_phone);
-            bool ret = _mysql_user->update(user);
-            if (ret == false) {
+            if (res == UpdateResult::CONFLICT) {
+                LOG_ERROR("{} - 该手机号已注册过用户 - {}！", request->request_id(), new_phone);
+                return err_response(request->request_id(), "该手机号已注册过用户!");
+            }
+            if (res != UpdateResult::OK) {
                 LOG_ERROR("{} - 更新数据库用户手机号失败 ：{}！", request->request_id(), new_phone);
                 return err_response(request->request_id(), "更新数据库用户手机号失败!");
             }
 
-            // 5. 更新 ES 服务器中用户信息
-            ret = _es_user->appendData(user->user_id(), user->phone(),
-                user->nickname(), user->description(), user->avatar_id());
+            // 4. 更新 ES 服务器中用户信息
+            bool ret = update_es_field(uid, "phone", new_phone);
             if (ret == false) {
                 LOG_ERROR("{} - 更新搜索引擎用户手机号失败 ：{}！", request->request_id(), new_phone);
                 return err_response(request->request_id(), "更新搜索引擎用户手机号失败!");
             }
 
-            // 6. 组织响应，返回更新成功与否
+            // 5. 组织响应，返回更新成功与否
             response->set_request_id(request->request_id());
             response->set_success(true);
         }
@@ -714,12 +720,14 @@ namespace liren
         // 数据访问组件
         ESUser::ptr _es_user;             // ES用户操作封装
         UserTable::ptr _mysql_user;       // MySQL用户表操作
+        UserCache::ptr _user_cache;       // 用户信息缓存，按用户ID查询时使用
         Session::ptr _redis_session;      // Redis会话管理
         Status::ptr _redis_status;        // 用户登录状态管理
         Codes::ptr _redis_codes;          // 验证码存储管理
 
         // 服务依赖配置
         std::string _file_service_name;   // 文件服务名称（用于服务发现）
+        int32_t _file_backup_request_ms;  // 下载文件（幂等调用）时，等待多久后向另一个节点发起备份请求
         ServiceManager::ptr _mm_channels; // 服务信道管理器（维护其他服务连接）
         DMSClient::ptr _dms_client;       // 短信平台客户端
     };
@@ -735,7 +743,7 @@ namespace liren
                    const Registry::ptr &reg_client,
                    const std::shared_ptr<elasticlient::Client> &es_client,
                    const std::shared_ptr<odb::core::database> &mysql_client,
-                   std::shared_ptr<sw::redis::Redis> &redis_client,
+                   const RedisClient::ptr &redis_client,
                    const std::shared_ptr<brpc::Server> &server):
                    _service_discoverer(service_discoverer),
                    _registry_client(reg_client),
@@ -758,7 +766,7 @@ namespace liren
         // 数据访问客户端
         std::shared_ptr<elasticlient::Client> _es_client;     // ES客户端
         std::shared_ptr<odb::core::database> _mysql_client;   // MySQL客户端
-        std::shared_ptr<sw::redis::Redis> _redis_client;      // Redis客户端
+        RedisClient::ptr _redis_client;                       // Redis客户端
 
         // brpc服务器实例
         std::shared_ptr<brpc::Server> _rpc_server;
@@ -786,30 +794,85 @@ namespace liren
                                 const std::string &db,
                                 const std::string &cset,
                                 int port,
-                                int conn_pool_count) {
-            _mysql_client = ODBFactory::create(user, pswd, host, db, cset, port, conn_pool_count);
+                                int conn_pool_count,
+                                const std::vector<std::string> &replica_hosts = {},  // 只读从库地址，为空表示读写都使用主库
+                                const ODBClusterOptions &cluster_options = ODBClusterOptions(),
+                                bool use_executor = true,    // 是否在独立线程池中执行MySQL操作
+                                const std::vector<std::string> &shard_addresses = {}, // 其余分片地址（host[:port]/db），为空表示不分片
+                                const std::string &index_address = "") {  // 全局索引库地址，为空时使用第一个分片
+            // 第一个分片为 host/db 及其从库，其余分片各自使用独立的连接池
+            _mysql_shards.clear();
+            _mysql_shards.push_back(ODBFactory::create_cluster(user, pswd, host, replica_hosts, db, cset, port,
+                                                               conn_pool_count, cluster_options));
+            size_t databases = 1 + replica_hosts.size();
+            for (size_t i = 0; i < shard_addresses.size(); ++i) {
+                ODBClusterOptions shard_options = cluster_options;
+                shard_options.metrics_prefix = cluster_options.metrics_prefix + "_shard" + std::to_string(i + 1);
+                _mysql_shards.push_back(ODBFactory::create_cluster(user, pswd, shard_addresses[i], cset, port,
+                                                                   conn_pool_count, shard_options));
+                ++databases;
+            }
+            _mysql_index = nullptr;
+            if (!index_address.empty() && _mysql_shards.size() > 1) {
+                ODBClusterOptions index_options = cluster_options;
+                index_options.metrics_prefix = cluster_options.metrics_prefix + "_index";
+                _mysql_index = ODBFactory::create_cluster(user, pswd, index_address, cset, port,
+                                                          conn_pool_count, index_options);
+                ++databases;
+            }
+            if (_mysql_shards.size() > 1) {
+                const ODBCluster::ptr &index = _mysql_index ? _mysql_index : _mysql_shards[0];
+                if (!UserTable::create_index(index->primary())) {
+                    LOG_ERROR("创建用户全局索引表失败！");
+                    abort();
+                }
+            }
+            _mysql_client = _mysql_shards[0]->primary();
+            if (use_executor) {
+                // 线程数与全部连接池的连接总数一致：线程再多也只会阻塞在获取连接上
+                ExecutorOptions options;
+                options.threads = conn_pool_count * databases;
+                options.metrics_prefix = "mysql_executor";
+                _mysql_executor = std::make_shared<Executor>(options);
+            }
         }
 
         // 构造redis客户端对象
         void make_redis_object(const std::string &host,
                                 int port,
                                 int db,
-                                bool keep_alive) {
-            _redis_client = RedisClientFactory::create(host, port, db, keep_alive);
+                                bool keep_alive,
+                                const SessionOptions &session_options = SessionOptions(),
+                                bool cluster = false,
+                                const RedisOptions &redis_options = RedisOptions()) {
+            _redis_client = RedisClientFactory::create_client(host, port, db, keep_alive, cluster, redis_options);
+            _session_options = session_options;
+        }
+
+        // 设置用户信息缓存参数（不调用时使用默认参数）
+        void make_user_cache_object(const UserCacheOptions &options) {
+            _user_cache_options = options;
         }
 
         // 构造服务发现客户端&&信道管理对象
         void make_discovery_object(const std::string &reg_host,
                                     const std::string &base_service_name,
-                                    const std::string &file_service_name) 
+                                    const std::string &file_service_name,
+                                    const brpc::ChannelOptions &file_channel_options = make_channel_options(),
+                                    const HealthOptions &health_options = HealthOptions(),
+                                    const std::string &snapshot_file = "",
+                                    const std::string &local_zone = "",
+                                    int32_t file_backup_request_ms = -1) 
         {
             _file_service_name = file_service_name;
-            _mm_channels = std::make_shared<ServiceManager>();
-            _mm_channels->declared(file_service_name);
+            _file_backup_request_ms = file_backup_request_ms;
+            _mm_channels = std::make_shared<ServiceManager>(health_options);
+            _mm_channels->set_local_zone(local_zone); // 优先调用同机房的子服务节点
+            _mm_channels->declared(file_service_name, file_channel_options);
             LOG_DEBUG("设置文件子服务为需添加管理的子服务：{}", file_service_name);
             auto put_cb = std::bind(&ServiceManager::online, _mm_channels.get(), std::placeholders::_1, std::placeholders::_2);
             auto del_cb = std::bind(&ServiceManager::offline, _mm_channels.get(), std::placeholders::_1, std::placeholders::_2);
-            _service_discoverer = std::make_shared<Discovery>(reg_host, base_service_name, put_cb, del_cb);
+            _service_discoverer = std::make_shared<Discovery>(reg_host, base_service_name, put_cb, del_cb, snapshot_file);
         }
 
         // 用于构造服务注册客户端对象
@@ -821,7 +884,16 @@ namespace liren
             _registry_client->regiter(service_name, access_host);
         }
 
-        void make_rpc_server(uint16_t port, int32_t timeout, uint8_t num_threads) 
+        // 以结构化元数据（权重、机房、最大并发、版本）注册用户服务，并周期性上报当前负载
+        void make_registry_object(const std::string &reg_host,
+                                const std::string &service_name,
+                                const InstanceMeta &meta) 
+        {
+            _registry_client = std::make_shared<Registry>(reg_host);
+            _registry_client->regiter(service_name, meta, Registry::cpu_load());
+        }
+
+        void make_rpc_server(uint16_t port, int32_t timeout, uint8_t num_threads, int32_t max_concurrency = 0) 
         {
             // 参数校验
             if (!_es_client) {
@@ -848,8 +920,9 @@ namespace liren
 
             // 注册服务实现
             UserServiceImpl *user_service = new UserServiceImpl(_dms_client, _es_client,
-                                                                _mysql_client, _redis_client, 
-                                                                _mm_channels, _file_service_name);
+                                                                _mysql_shards, _mysql_index, _mysql_executor, _redis_client, 
+                                                                _mm_channels, _file_service_name, _file_backup_request_ms,
+                                                                _session_options, _user_cache_options);
             int ret = _rpc_server->AddService(user_service, 
                 brpc::ServiceOwnership::SERVER_OWNS_SERVICE);
             if (ret == -1) {
@@ -861,6 +934,7 @@ namespace liren
             brpc::ServerOptions options;
             options.idle_timeout_sec = timeout;
             options.num_threads = num_threads;
+            options.max_concurrency = max_concurrency;
             ret = _rpc_server->Start(port, &options);
             if (ret == -1) {
                 LOG_ERROR("服务启动失败！");
@@ -895,9 +969,15 @@ namespace liren
         Registry::ptr _registry_client; // 服务注册客户端：负责将本服务注册到服务注册中心
         std::shared_ptr<elasticlient::Client> _es_client;   // ES客户端：用于用户信息的全文检索、数据分析等高级查询功能
         std::shared_ptr<odb::core::database> _mysql_client; // MySQL数据库连接：处理用户核心数据的持久化存储（注册信息、资料修改等）
-        std::shared_ptr<sw::redis::Redis> _redis_client;    // Redis客户端：管理会话状态（登录态）、验证码存储、用户在线状态等时效性数据
+        std::vector<ODBCluster::ptr> _mysql_shards;         // MySQL用户表分片：每个分片写操作走主库，查询分摊到从库
+        ODBCluster::ptr _mysql_index;                       // MySQL全局索引库：昵称、手机号到用户ID的索引，为空时使用第一个分片
+        Executor::ptr _mysql_executor;                      // MySQL操作执行线程池：阻塞调用不占用brpc的bthread工作线程
+        RedisClient::ptr _redis_client;                     // Redis客户端：管理会话状态（登录态）、验证码存储、用户在线状态等时效性数据
+        SessionOptions _session_options;                    // 会话有效期（滑动过期）与 ssid->uid 近端缓存参数
+        UserCacheOptions _user_cache_options;               // 用户信息缓存（进程内 LRU + Redis）参数
 
         std::string _file_service_name;     // 该模块所依赖的文件管理子服务，在服务注册中心注册的服务名
+        int32_t _file_backup_request_ms = -1; // 下载文件时跨节点备份请求的等待时间，小于0表示不发起
         ServiceManager::ptr _mm_channels;   // 服务信道管理器：维护与其他微服务的通信通道
         Discovery::ptr _service_discoverer; // 服务发现客户端：从注册中心订阅其他服务实例变更
 
@@ -0,0 +1,61 @@
+#include "../../../header/mysql_user.hpp"
+#include "../../../odb/user.hxx"
+#include "user-odb.hxx"
+#include <gflags/gflags.h>
+#include <sstream>
+
+DEFINE_bool(run_mode, false, "程序的运行模式，false-调试； true-发布；");
+DEFINE_string(log_file, "", "发布模式下，用于指定日志的输出文件");
+DEFINE_int32(log_level, 0, "发布模式下，用于指定日志输出等级");
+
+DEFINE_bool(prepare, false, "是否先插入测试用户（bench_uid_0 ~ bench_uid_4999）");
+DEFINE_int32(rounds, 200, "每种列表长度的查询次数");
+
+// 旧实现：拼接 user_id in ('a','b',...) 文本查询，每次都由 MySQL 重新解析
+std::vector<liren::User> select_by_text(const std::shared_ptr<odb::core::database> &db,
+                                        const std::vector<std::string> &id_list) 
+{
+    std::vector<liren::User> res;
+    odb::transaction trans(db->begin());
+    typedef odb::result<liren::User> result;
+    std::stringstream ss;
+    ss << "user_id in (";
+    for (const auto &id : id_list) ss << "'" << id << "',";
+    std::string condition = ss.str();
+    condition.pop_back();
+    condition += ")";
+    result r(db->query<liren::User>(condition));
+    for (result::iterator i(r.begin()); i != r.end(); ++i) res.push_back(*i);
+    trans.commit();
+    return res;
+}
+
+// 批量查询耗时对比：列表长度 1 ~ 5000，文本拼接 IN 与分块预编译 IN
+int main(int argc, char *argv[])
+{
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    liren::init_logger(FLAGS_run_mode, FLAGS_log_file, FLAGS_log_level);
+
+    auto db = liren::ODBFactory::create("root", "TThh1314520!", "127.0.0.1", "liren", "utf8", 0, 1);
+    liren::UserTable user_tb(db);
+
+    std::vector<std::string> all;
+    for (int i = 0; i < 5000; ++i) all.push_back("bench_uid_" + std::to_string(i));
+    if (FLAGS_prepare) {
+        for (auto &uid : all) user_tb.insert(std::make_shared<liren::User>(uid, uid, "123456"));
+    }
+
+    std::cout << "列表长度\t文本拼接(us)\t预编译(us)\t返回行数" << std::endl;
+    for (size_t size : {1, 5, 8, 20, 32, 100, 128, 500, 1000, 2000, 5000}) {
+        std::vector<std::string> ids(all.begin(), all.begin() + size);
+        size_t rows = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < FLAGS_rounds; ++i) rows = select_by_text(db, ids).size();
+        double text_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / FLAGS_rounds;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < FLAGS_rounds; ++i) rows = user_tb.select_multi_users(ids).size();
+        double prepared_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / FLAGS_rounds;
+        std::cout << size << "\t" << text_us << "\t" << prepared_us << "\t" << rows << std::endl;
+    }
+    return 0;
+}
@@ -41,6 +41,7 @@
 #include <odb/no-op-cache-traits.hxx>
 #include <odb/result.hxx>
 #include <odb/simple-object-result.hxx>
+#include <odb/prepared-query.hxx>
 
 #include <odb/details/unused.hxx>
 #include <odb/details/shared-ptr.hxx>
@@ -376,6 +377,12 @@ namespace odb
     static unsigned long long
     erase_query (database&, const query_base_type&);
 
+    static odb::details::shared_ptr<prepared_query_impl>
+    prepare_query (connection&, const char*, const query_base_type&);
+
+    static odb::details::shared_ptr<result_impl>
+    execute_query (prepared_query_impl&);
+
     public:
     static bool
     find_ (statements_type&,
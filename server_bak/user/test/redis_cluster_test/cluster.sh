@@ -0,0 +1,31 @@
+#!/bin/bash
+# 在本机启动一个 3 主 3 从的 Redis Cluster，用于集群模式测试
+#   ./cluster.sh start   启动 7000~7005 六个实例并组建集群
+#   ./cluster.sh stop    停止所有实例并清理数据目录
+DIR=$(cd "$(dirname "$0")" && pwd)/cluster_data
+PORTS="7000 7001 7002 7003 7004 7005"
+
+case "$1" in
+start)
+    for port in $PORTS; do
+        mkdir -p "$DIR/$port"
+        redis-server --port $port --cluster-enabled yes \
+            --cluster-config-file "$DIR/$port/nodes.conf" \
+            --dir "$DIR/$port" --appendonly no --daemonize yes \
+            --logfile "$DIR/$port/redis.log"
+    done
+    sleep 1
+    nodes=""
+    for port in $PORTS; do nodes="$nodes 127.0.0.1:$port"; done
+    redis-cli --cluster create $nodes --cluster-replicas 1 --cluster-yes
+    ;;
+stop)
+    for port in $PORTS; do
+        redis-cli -p $port shutdown nosave 2>/dev/null
+    done
+    rm -rf "$DIR"
+    ;;
+*)
+    echo "usage: $0 start|stop"
+    ;;
+esac
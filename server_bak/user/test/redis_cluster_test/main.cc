@@ -0,0 +1,64 @@
+#include "../../../header/data_redis.hpp"   // 包含 Redis 操作封装头文件（定义了 Session、Status、Codes、RedisClientFactory 等类）
+#include <gflags/gflags.h>
+
+// 先执行 ./cluster.sh start 在本机启动 3 主 3 从的测试集群
+DEFINE_string(ip, "127.0.0.1", "任意一个集群节点的IP地址，格式：127.0.0.1");
+DEFINE_int32(port, 7000, "任意一个集群节点的端口");
+DEFINE_bool(keep_alive, true, "是否进行长连接保活");
+
+// hash_tag_test 函数验证键名规则：同一用户的会话键与在线状态键携带相同的哈希标签
+void hash_tag_test() 
+{
+    std::string ssid = liren::RedisKey::make_ssid("用户ID1", "会话ID1");
+    std::string session_key = liren::RedisKey::session(ssid);
+    std::string status_key = liren::RedisKey::status("用户ID1");
+    std::cout << session_key << " -> " << liren::RedisKey::hash_tag(session_key) << std::endl;
+    std::cout << status_key << " -> " << liren::RedisKey::hash_tag(status_key) << std::endl;
+    if (liren::RedisKey::hash_tag(session_key) == liren::RedisKey::hash_tag(status_key)) 
+        std::cout << "会话键与在线状态键位于同一槽位！" << std::endl;
+}
+
+// login_test 函数在集群上测试登录脚本、会话续期与删除（脚本中的键必须位于同一槽位，否则会报 CROSSSLOT 错误）
+void login_test(const liren::RedisClient::ptr &client) 
+{
+    liren::SessionOptions options;
+    options.ttl = std::chrono::seconds(60);
+    options.cache_ttl = std::chrono::milliseconds(500);
+    liren::Session ss(client, options);
+    liren::Status status(client);
+    liren::Codes codes(client);
+
+    // 不同用户的会话分布在不同的节点上
+    for (int i = 0; i < 10; ++i) {
+        std::string uid = "用户ID" + std::to_string(i);
+        std::string ssid = liren::RedisKey::make_ssid(uid, "会话ID" + std::to_string(i));
+        if (ss.login(ssid, uid) != liren::LoginResult::OK) std::cout << uid << "登录失败！" << std::endl;
+        auto res = ss.uid(ssid);
+        if (!res || *res != uid) std::cout << uid << "会话查询失败！" << std::endl;
+    }
+    std::string ssid = liren::RedisKey::make_ssid("用户ID0", "会话ID10");
+    if (ss.login(ssid, "用户ID0") == liren::LoginResult::ALREADY_ONLINE) std::cout << "用户0重复登录被拒绝！" << std::endl;
+
+    // 验证码键与会话键不在同一槽位，集群模式下分两步执行
+    codes.append("验证码ID1", "验证码1");
+    ssid = liren::RedisKey::make_ssid("用户ID10", "会话ID11");
+    if (ss.login(ssid, "用户ID10", "验证码ID1", "错误验证码") == liren::LoginResult::CODE_MISMATCH) std::cout << "验证码错误！" << std::endl;
+    if (ss.login(ssid, "用户ID10", "验证码ID1", "验证码1") == liren::LoginResult::OK) std::cout << "用户10登录成功！" << std::endl;
+
+    for (int i = 0; i <= 10; ++i) {
+        std::string uid = "用户ID" + std::to_string(i);
+        ss.remove(liren::RedisKey::make_ssid(uid, "会话ID" + std::to_string(i == 10 ? 11 : i)));
+        status.remove(uid);
+    }
+    if (!ss.uid(ssid)) std::cout << "会话已全部删除！" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    google::ParseCommandLineFlags(&argc, &argv, true);
+
+    auto client = liren::RedisClientFactory::create_client(FLAGS_ip, FLAGS_port, 0, FLAGS_keep_alive, true);
+    hash_tag_test();
+    login_test(client);
+    return 0;
+}
@@ -12,7 +12,7 @@ DEFINE_int32(db, 0, "库的编号：默认0号");
 DEFINE_bool(keep_alive, true, "是否进行长连接保活");
 
 // session_test 函数用于测试 Session 类的功能：添加会话、删除会话和获取会话对应的用户ID
-void session_test(const std::shared_ptr<sw::redis::Redis> &client) 
+void session_test(const liren::RedisClient::ptr &client) 
 {
     // 创建 Session 对象，传入 Redis 客户端
     liren::Session ss(client);
@@ -39,7 +39,7 @@ void session_test(const std::shared_ptr<sw::redis::Redis> &client)
 }
 
 // status_test 函数用于测试 Status 类的功能：添加在线状态、删除状态以及检测状态是否存在
-void status_test(const std::shared_ptr<sw::redis::Redis> &client) 
+void status_test(const liren::RedisClient::ptr &client) 
 {
     // 创建 Status 对象，传入 Redis 客户端
     liren::Status status(client);
@@ -56,10 +56,16 @@ void status_test(const std::shared_ptr<sw::redis::Redis> &client)
     if (status.exists("用户ID1")) std::cout << "用户1在线！" << std::endl;
     if (status.exists("用户ID2")) std::cout << "用户2在线！" << std::endl;
     if (status.exists("用户ID3")) std::cout << "用户3在线！" << std::endl;
+
+    // 批量检测在线状态，一次往返返回所有结果
+    std::vector<std::string> uids = {"用户ID1", "用户ID2", "用户ID3", "用户ID4"};
+    auto online = status.exists_many(uids);
+    for (size_t i = 0; i < uids.size(); ++i) 
+        std::cout << uids[i] << (online[i] ? " 在线" : " 离线") << std::endl;
 }
 
 // code_test 函数用于测试 Codes 类的功能：添加验证码、删除验证码以及查询验证码，并测试验证码超时效果
-void code_test(const std::shared_ptr<sw::redis::Redis> &client) 
+void code_test(const liren::RedisClient::ptr &client) 
 {
     // 创建 Codes 对象，传入 Redis 客户端
     liren::Codes codes(client);
@@ -92,17 +98,42 @@ void code_test(const std::shared_ptr<sw::redis::Redis> &client)
     if (!y6) std::cout << "验证码ID3不存在" << std::endl;
 }
 
+// login_test 函数用于测试 Session::login 的原子登录：验证码校验、重复登录检测
+void login_test(const liren::RedisClient::ptr &client) 
+{
+    liren::Session ss(client);
+    liren::Status status(client);
+    liren::Codes codes(client);
+
+    // 第一次登录成功，第二次登录会检测到用户已在线
+    if (ss.login("会话ID5", "用户ID5") == liren::LoginResult::OK) std::cout << "用户5登录成功！" << std::endl;
+    if (ss.login("会话ID6", "用户ID5") == liren::LoginResult::ALREADY_ONLINE) std::cout << "用户5重复登录被拒绝！" << std::endl;
+    if (status.exists("用户ID5")) std::cout << "用户5在线！" << std::endl;
+
+    // 带验证码登录：错误的验证码不会消耗验证码，正确的验证码只能使用一次
+    codes.append("验证码ID4", "验证码4");
+    if (ss.login("会话ID7", "用户ID6", "验证码ID4", "错误验证码") == liren::LoginResult::CODE_MISMATCH) std::cout << "验证码错误！" << std::endl;
+    if (ss.login("会话ID7", "用户ID6", "验证码ID4", "验证码4") == liren::LoginResult::OK) std::cout << "用户6登录成功！" << std::endl;
+    if (!codes.code("验证码ID4")) std::cout << "验证码ID4已被删除" << std::endl;
+
+    ss.remove("会话ID5");
+    ss.remove("会话ID7");
+    status.remove("用户ID5");
+    status.remove("用户ID6");
+}
+
 int main(int argc, char *argv[])
 {
     google::ParseCommandLineFlags(&argc, &argv, true);
 //  liren::init_logger(FLAGS_run_mode, FLAGS_log_file, FLAGS_log_level);
 
     // 通过 RedisClientFactory 创建 Redis 客户端对象，使用命令行参数设置 IP、端口、数据库编号和长连接保活选项
-    auto client = liren::RedisClientFactory::create(FLAGS_ip, FLAGS_port, FLAGS_db, FLAGS_keep_alive);
+    auto client = liren::RedisClientFactory::create_client(FLAGS_ip, FLAGS_port, FLAGS_db, FLAGS_keep_alive);
 
     // 运行不同的测试函数，可根据需要取消注释相应的测试
     session_test(client);
     status_test(client);
     code_test(client);   
+    login_test(client);
     return 0;
 }
@@ -0,0 +1,54 @@
+#include "../../../header/data_redis.hpp"   // 包含 Session、SessionToken 等会话相关封装
+#include <gflags/gflags.h>
+
+// 对比每次请求鉴权的开销：本地校验签名令牌 vs 通过 Redis 查询会话ID
+DEFINE_string(ip, "127.0.0.1", "Redis服务器IP地址");
+DEFINE_int32(port, 6379, "Redis服务器端口");
+DEFINE_int32(db, 0, "库的编号：默认0号");
+DEFINE_int32(count, 100000, "每种方式的鉴权次数");
+DEFINE_bool(with_redis, true, "是否同时测试通过 Redis 查询会话的耗时");
+
+DEFINE_bool(run_mode, false, "程序的运行模式，false-调试； true-发布；");
+DEFINE_string(log_file, "", "发布模式下，用于指定日志的输出文件");
+DEFINE_int32(log_level, 2, "发布模式下，用于指定日志输出等级");
+
+template <typename F>
+void bench(const std::string &name, int count, F &&f) 
+{
+    auto start = std::chrono::steady_clock::now();
+    int ok = 0;
+    for (int i = 0; i < count; ++i) if (f()) ++ok;
+    auto cost = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << count << " 次, 成功 " << ok << " 次, 平均 " << cost / count << " ns/次" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    liren::init_logger(FLAGS_run_mode, FLAGS_log_file, FLAGS_log_level);
+
+    // 1. 纯本地令牌校验：HMAC-SHA256 + 解码
+    liren::SessionToken signer("token_bench_secret");
+    std::string token = signer.sign("用户ID1", "{用户ID1}会话ID1", time(nullptr) + 3600);
+    liren::SessionToken::Claims claims;
+    bench("SessionToken::verify", FLAGS_count, [&]() { return signer.verify(token, claims); });
+    if (!FLAGS_with_redis) return 0;
+
+    // 2. Session::uid：令牌模式（本地校验 + 本地吊销列表）与普通会话ID模式（每次访问 Redis）
+    auto client = liren::RedisClientFactory::create_client(FLAGS_ip, FLAGS_port, FLAGS_db, true);
+    liren::SessionOptions options;
+    options.token_secret = "token_bench_secret";
+    liren::Session token_session(client, options);
+    liren::Session redis_session(client);
+
+    std::string ssid = liren::RedisKey::make_ssid("用户ID1", "会话ID1");
+    redis_session.append(ssid, "用户ID1");
+    token = token_session.issue(ssid, "用户ID1");
+    bench("Session::uid(令牌)", FLAGS_count, [&]() { return static_cast<bool>(token_session.uid(token)); });
+    bench("Session::uid(Redis)", FLAGS_count, [&]() { return static_cast<bool>(redis_session.uid(ssid)); });
+
+    // 3. 注销后令牌立即在本进程失效
+    token_session.remove(token);
+    if (!token_session.uid(token)) std::cout << "令牌已吊销！" << std::endl;
+    return 0;
+}
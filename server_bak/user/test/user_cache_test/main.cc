@@ -0,0 +1,70 @@
+#include "../../../header/user_cache.hpp"
+#include "../../../odb/user.hxx"
+#include "user-odb.hxx"
+#include <gflags/gflags.h>
+#include <thread>
+
+DEFINE_bool(run_mode, false, "程序的运行模式，false-调试； true-发布；");
+DEFINE_string(log_file, "", "发布模式下，用于指定日志的输出文件");
+DEFINE_int32(log_level, 0, "发布模式下，用于指定日志输出等级");
+
+DEFINE_string(redis_ip, "127.0.0.1", "Redis服务器的IP地址");
+DEFINE_int32(redis_port, 6379, "Redis服务器的端口");
+DEFINE_int32(threads, 32, "并发查询同一用户的线程数");
+DEFINE_int32(count, 100000, "读取耗时测试的查询次数");
+
+// 用户信息缓存测试：
+//   1. 多个线程同时查询未缓存的用户，只有一次查询落到 MySQL（single-flight）
+//   2. 修改用户后再次查询，读到的是新数据（变更即失效）
+//   3. 不存在的用户ID被缓存，重复查询不再访问 MySQL
+//   4. 对比直接查询 MySQL 与经过缓存查询的耗时
+int main(int argc, char *argv[])
+{
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    liren::init_logger(FLAGS_run_mode, FLAGS_log_file, FLAGS_log_level);
+
+    auto db = liren::ODBFactory::create("root", "TThh1314520!", "127.0.0.1", "liren", "utf8", 0, 4);
+    auto table = std::make_shared<liren::UserTable>(db);
+    auto redis = liren::RedisClientFactory::create_client(FLAGS_redis_ip, FLAGS_redis_port, 0, true);
+    liren::UserCache cache(table, redis);
+
+    auto user = std::make_shared<liren::User>("cache_uid1", "缓存测试昵称1", "123456");
+    table->insert(user);
+
+    // 1. 并发查询
+    std::vector<std::thread> threads;
+    for (int i = 0; i < FLAGS_threads; ++i) {
+        threads.emplace_back([&cache]() {
+            std::shared_ptr<liren::User> u;
+            if (!cache.get("cache_uid1", u) || !u) std::cout << "查询用户失败" << std::endl;
+        });
+    }
+    for (auto &t : threads) t.join();
+
+    // 2. 修改后查询
+    std::shared_ptr<liren::User> u;
+    cache.get("cache_uid1", u);
+    u->description("修改后的签名");
+    table->update(u);
+    cache.get("cache_uid1", u);
+    std::cout << "修改后的签名: " << u->description() << std::endl;
+
+    // 3. 不存在的用户
+    for (int i = 0; i < 10; ++i) {
+        if (cache.get("cache_uid_not_exists", u) && u) std::cout << "不存在的用户查询到了结果" << std::endl;
+    }
+
+    // 4. 耗时对比
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 1000; ++i) table->select_by_id("cache_uid1");
+    double mysql_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / 1000;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < FLAGS_count; ++i) cache.get("cache_uid1", u);
+    double cache_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / FLAGS_count;
+    std::cout << "MySQL查询: " << mysql_us << " us/次，缓存查询: " << cache_us << " us/次" << std::endl;
+
+    // 指标：user_cache_misses 预期为 3（首次查询、修改后查询、不存在的用户各一次）
+    std::cout << "user_cache_misses: " << bvar::Variable::describe_exposed("user_cache_misses") << std::endl;
+    std::cout << "user_cache_hit_ratio: " << bvar::Variable::describe_exposed("user_cache_hit_ratio") << std::endl;
+    return 0;
+}
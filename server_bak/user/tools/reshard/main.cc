@@ -0,0 +1,300 @@
+#include "../../../header/mysql_user.hpp"
+#include "../../../odb/user.hxx"
+#include "user-odb.hxx"
+#include <gflags/gflags.h>
+#include <sstream>
+#include <thread>
+
+// 用户表重新分片工具：把用户记录从当前分片布局（--from）复制到新的分片布局（--to）并校验
+// 分片规则与 UserTable::shard_of 一致，分片地址的顺序决定分片下标，需要与用户服务的配置一致
+//   用户服务：--mysql_host/--mysql_db 为第 0 个分片，--mysql_shards 依次为第 1..N-1 个分片
+//
+// 迁移步骤（用户服务不删除用户记录，因此只需要同步新增与修改）：
+//   1. copy：服务正常运行时执行，可重复执行，只写入与目标分片不一致的记录
+//   2. catchup：服务正常运行时执行，重复 copy 直到一轮中不一致的记录数不超过 --catchup_rows，
+//      用于在停写前把差异追到足够小（用户表没有修改时间列，每轮仍需扫描全部记录，但只写入差异）
+//   3. 短暂停止用户服务的写入（或停服），再执行一次 copy，随后执行 index 与 verify；
+//      停写时长约为一轮扫描加 index 的耗时，无法做到完全不停写
+//   4. verify 无差异后，以新的 --mysql_shards/--mysql_index 重启用户服务
+//   5. cleanup：删除目标分片中不属于该分片的记录（例如原单库作为新的第 0 个分片时留下的其他用户）
+// 单条记录写入失败时记录日志并继续，结束时以非 0 退出码返回
+
+DEFINE_bool(run_mode, false, "程序的运行模式，false-调试； true-发布；");
+DEFINE_string(log_file, "", "发布模式下，用于指定日志的输出文件");
+DEFINE_int32(log_level, 0, "发布模式下，用于指定日志输出等级");
+
+DEFINE_string(mysql_user, "root", "Mysql服务器访问用户名");
+DEFINE_string(mysql_pswd, "TThh1314520!", "Mysql服务器访问密码");
+DEFINE_string(mysql_cset, "utf8", "Mysql客户端字符集");
+DEFINE_int32(mysql_port, 0, "地址中未指定端口时使用的Mysql端口");
+
+DEFINE_string(from, "127.0.0.1/liren", "当前分片地址列表，以逗号分隔，每项为 host/db 或 host:port/db");
+DEFINE_string(to, "", "新的分片地址列表，格式同 from");
+DEFINE_string(index, "", "新布局的全局索引库地址，为空时使用 to 中的第一个分片");
+DEFINE_string(mode, "copy", "copy-复制到新分片；catchup-重复复制直到差异足够小；verify-校验新分片与源分片一致；"
+    "index-重建全局索引；cleanup-删除不属于所在分片的记录");
+DEFINE_int32(batch, 500, "每批读取的记录数");
+DEFINE_int32(catchup_rows, 100, "catchup 模式下一轮复制的记录数不超过该值时结束");
+DEFINE_int32(catchup_rounds, 20, "catchup 模式下最多复制的轮数");
+DEFINE_int32(catchup_interval, 1000, "catchup 模式下两轮复制之间的间隔时间，单位毫秒");
+
+using Shards = std::vector<liren::ODBCluster::ptr>;
+
+Shards create_shards(const std::string &addresses, const std::string &prefix) {
+    Shards shards;
+    std::stringstream ss(addresses);
+    for (std::string address; std::getline(ss, address, ',');) {
+        if (address.empty()) continue;
+        liren::ODBClusterOptions options;
+        options.metrics_prefix = prefix + std::to_string(shards.size());
+        shards.push_back(liren::ODBFactory::create_cluster(FLAGS_mysql_user, FLAGS_mysql_pswd, address,
+            FLAGS_mysql_cset, FLAGS_mysql_port, 1, options));
+    }
+    return shards;
+}
+
+// 按主键顺序分批读取一个库中的全部用户记录
+template <typename F>
+void scan(const liren::ODBCluster::DB &db, F &&f) {
+    unsigned long last = 0;
+    while (true) {
+        std::vector<liren::User> users;
+        {
+            odb::transaction trans(db->begin());
+            typedef odb::result<liren::User> result;
+            result r(db->query<liren::User>("id > " + std::to_string(last) +
+                " ORDER BY id LIMIT " + std::to_string(FLAGS_batch)));
+            for (result::iterator i(r.begin()); i != r.end(); ++i) users.push_back(*i);
+            trans.commit();
+        }
+        if (users.empty()) return;
+        last = users.back().id();
+        f(users);
+    }
+}
+
+std::shared_ptr<liren::User> find_user(const liren::ODBCluster::DB &db, const std::string &uid) {
+    typedef odb::query<liren::User> query;
+    return std::shared_ptr<liren::User>(db->query_one<liren::User>(query::user_id == uid));
+}
+
+bool same_user(liren::User &a, liren::User &b) {
+    return a.user_id() == b.user_id() && a.nickname() == b.nickname() &&
+        a.description() == b.description() && a.password() == b.password() &&
+        a.phone() == b.phone() && a.avatar_id() == b.avatar_id();
+}
+
+// 把一条记录按用户ID覆盖写入目标库，目标库中的主键由目标库分配
+// 返回 1 表示写入了该记录，0 表示目标库中已一致，-1 表示写入失败（已记录日志）
+int copy_user(const liren::ODBCluster::DB &db, liren::User &user) {
+    try {
+        odb::transaction trans(db->begin());
+        auto old = find_user(db, user.user_id());
+        liren::User copy(user);
+        if (old) {
+            if (same_user(*old, copy)) return 0;
+            copy.id(old->id());
+            db->update(copy);
+        } else {
+            db->persist(copy);
+        }
+        trans.commit();
+        return 1;
+    } catch (std::exception &e) {
+        LOG_ERROR("复制用户 {} 失败：{}", user.user_id(), e.what());
+    }
+    return -1;
+}
+
+// 把源分片的记录写入所属的目标分片，changed 返回本轮写入的记录数
+bool copy(const Shards &from, const Shards &to, size_t &changed) {
+    size_t scanned = 0, failed = 0;
+    changed = 0;
+    for (auto &source : from) {
+        scan(source->primary(), [&](std::vector<liren::User> &users) {
+            for (auto &user : users) {
+                int ret = copy_user(to[liren::UserTable::shard_of(user.user_id(), to.size())]->primary(), user);
+                if (ret > 0) ++changed;
+                else if (ret < 0) ++failed;
+            }
+            scanned += users.size();
+            LOG_INFO("已扫描 {} 条用户记录，写入 {} 条", scanned, changed);
+        });
+    }
+    LOG_INFO("复制完成：共 {} 条，写入 {} 条，失败 {} 条", scanned, changed, failed);
+    return failed == 0;
+}
+
+// 重复复制直到一轮写入的记录数不超过 --catchup_rows，此时停写后的最后一轮 copy 只需写入少量差异
+bool catchup(const Shards &from, const Shards &to) {
+    for (int round = 1; round <= FLAGS_catchup_rounds; ++round) {
+        size_t changed = 0;
+        bool ok = copy(from, to, changed);
+        LOG_INFO("第 {} 轮复制写入 {} 条记录", round, changed);
+        if (ok && changed <= (size_t)FLAGS_catchup_rows) {
+            LOG_INFO("差异已追平到 {} 条以内，可以停止写入并执行最后一轮 copy", FLAGS_catchup_rows);
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(FLAGS_catchup_interval));
+    }
+    LOG_ERROR("{} 轮复制后差异仍未追平，写入速度可能超过复制速度", FLAGS_catchup_rounds);
+    return false;
+}
+
+// 校验源分片中的每条记录都已存在于所属的目标分片且内容一致
+bool verify(const Shards &from, const Shards &to) {
+    size_t total = 0, missing = 0, mismatch = 0;
+    for (auto &source : from) {
+        scan(source->primary(), [&](std::vector<liren::User> &users) {
+            for (auto &user : users) {
+                auto &db = to[liren::UserTable::shard_of(user.user_id(), to.size())]->primary();
+                odb::transaction trans(db->begin());
+                auto target = find_user(db, user.user_id());
+                trans.commit();
+                ++total;
+                if (!target) {
+                    ++missing;
+                    LOG_ERROR("目标分片中缺少用户 {}", user.user_id());
+                } else if (!same_user(*target, user)) {
+                    ++mismatch;
+                    LOG_ERROR("目标分片中用户 {} 的信息与源分片不一致", user.user_id());
+                }
+            }
+        });
+    }
+    LOG_INFO("校验完成：共 {} 条，缺少 {} 条，不一致 {} 条", total, missing, mismatch);
+    return missing == 0 && mismatch == 0;
+}
+
+// 转义字符串，用于拼接到单引号内
+std::string escape(MYSQL *handle, const std::string &str) {
+    std::string res(str.size() * 2 + 1, '\0');
+    res.resize(mysql_real_escape_string(handle, &res[0], str.c_str(), str.size()));
+    return res;
+}
+
+bool execute(MYSQL *handle, const std::string &sql) {
+    if (mysql_real_query(handle, sql.c_str(), sql.size()) != 0) {
+        LOG_ERROR("执行语句失败 {}:{}", sql, mysql_error(handle));
+        return false;
+    }
+    return true;
+}
+
+// 根据目标分片中的用户记录重建全局索引：登记全部昵称、手机号，并删除与用户记录不一致的索引行
+bool rebuild_index(const Shards &to, const liren::ODBCluster::ptr &index) {
+    if (!liren::UserTable::create_index(index->primary())) return false;
+    odb::mysql::connection_ptr conn(static_cast<odb::mysql::database &>(*index->primary()).connection());
+    MYSQL *handle = conn->handle();
+    const liren::UserTable::Index *indexes[] = {&liren::UserTable::NICKNAME_INDEX, &liren::UserTable::PHONE_INDEX};
+    bool ok = true;
+    size_t registered = 0;
+    for (size_t i = 0; i < to.size(); ++i) {
+        scan(to[i]->primary(), [&](std::vector<liren::User> &users) {
+            for (auto &user : users) {
+                // 目标分片中不属于该分片的记录等待 cleanup 删除，不登记索引
+                if (liren::UserTable::shard_of(user.user_id(), to.size()) != i) continue;
+                for (auto *idx : indexes) {
+                    std::string key = idx == indexes[0] ? user.nickname() : user.phone();
+                    if (key.empty()) continue;
+                    ok &= execute(handle, std::string("INSERT INTO `") + idx->table + "` (`" + idx->column +
+                        "`, `user_id`) VALUES ('" + escape(handle, key) + "', '" + escape(handle, user.user_id()) +
+                        "') ON DUPLICATE KEY UPDATE `user_id` = VALUES(`user_id`)");
+                }
+                ++registered;
+            }
+        });
+    }
+    LOG_INFO("已登记 {} 个用户的索引", registered);
+
+    // 逐表扫描索引行，删除指向不存在用户或用户已改用其他值的行
+    size_t removed = 0;
+    for (auto *idx : indexes) {
+        std::string last;
+        while (true) {
+            std::vector<std::pair<std::string, std::string>> rows;
+            std::string sql = std::string("SELECT `") + idx->column + "`, `user_id` FROM `" + idx->table +
+                "` WHERE `" + idx->column + "` > '" + escape(handle, last) + "' ORDER BY `" + idx->column +
+                "` LIMIT " + std::to_string(FLAGS_batch);
+            if (!execute(handle, sql)) return false;
+            MYSQL_RES *res = mysql_store_result(handle);
+            if (!res) return false;
+            while (MYSQL_ROW row = mysql_fetch_row(res)) rows.emplace_back(row[0], row[1]);
+            mysql_free_result(res);
+            if (rows.empty()) break;
+            last = rows.back().first;
+            for (auto &row : rows) {
+                auto &db = to[liren::UserTable::shard_of(row.second, to.size())]->primary();
+                odb::transaction trans(db->begin());
+                auto user = find_user(db, row.second);
+                trans.commit();
+                std::string key;
+                if (user) key = idx == indexes[0] ? user->nickname() : user->phone();
+                if (key == row.first) continue;
+                ok &= execute(handle, std::string("DELETE FROM `") + idx->table + "` WHERE `" + idx->column +
+                    "` = '" + escape(handle, row.first) + "' AND `user_id` = '" + escape(handle, row.second) + "'");
+                ++removed;
+            }
+        }
+    }
+    LOG_INFO("索引重建完成，删除 {} 条无效索引", removed);
+    return ok;
+}
+
+// 删除目标分片中不属于该分片的记录，只能在用户服务切换到新布局之后执行
+bool cleanup(const Shards &to) {
+    size_t removed = 0, failed = 0;
+    for (size_t i = 0; i < to.size(); ++i) {
+        auto &db = to[i]->primary();
+        scan(db, [&](std::vector<liren::User> &users) {
+            for (auto &user : users) {
+                if (liren::UserTable::shard_of(user.user_id(), to.size()) == i) continue;
+                try {
+                    odb::transaction trans(db->begin());
+                    db->erase(user);
+                    trans.commit();
+                    ++removed;
+                } catch (std::exception &e) {
+                    LOG_ERROR("删除用户 {} 失败：{}", user.user_id(), e.what());
+                    ++failed;
+                }
+            }
+        });
+    }
+    LOG_INFO("清理完成，删除 {} 条不属于所在分片的记录，失败 {} 条", removed, failed);
+    return failed == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    liren::init_logger(FLAGS_run_mode, FLAGS_log_file, FLAGS_log_level);
+
+    Shards from = create_shards(FLAGS_from, "reshard_from");
+    Shards to = create_shards(FLAGS_to, "reshard_to");
+    if (from.empty() || to.empty()) {
+        LOG_ERROR("需要同时指定 --from 与 --to");
+        return -1;
+    }
+    liren::ODBCluster::ptr index = to[0];
+    if (!FLAGS_index.empty()) {
+        liren::ODBClusterOptions options;
+        options.metrics_prefix = "reshard_index";
+        index = liren::ODBFactory::create_cluster(FLAGS_mysql_user, FLAGS_mysql_pswd, FLAGS_index,
+            FLAGS_mysql_cset, FLAGS_mysql_port, 1, options);
+    }
+
+    bool ret = false;
+    try {
+        size_t changed = 0;
+        if (FLAGS_mode == "copy") ret = copy(from, to, changed);
+        else if (FLAGS_mode == "catchup") ret = catchup(from, to);
+        else if (FLAGS_mode == "verify") ret = verify(from, to);
+        else if (FLAGS_mode == "index") ret = rebuild_index(to, index);
+        else if (FLAGS_mode == "cleanup") ret = cleanup(to);
+        else LOG_ERROR("未知的模式：{}", FLAGS_mode);
+    } catch (std::exception &e) {
+        LOG_ERROR("{} 执行失败：{}", FLAGS_mode, e.what());
+    }
+    return ret ? 0 : 1;
+}